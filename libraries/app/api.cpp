@@ -101,10 +101,12 @@ namespace graphene { namespace app {
        {
           /// we need to ensure the database_api is not deleted for the life of the async operation
           auto capture_this = shared_from_this();
+          // the ids were computed before the block was applied
+          const auto& applied_trxs = _app.chain_database()->get_applied_transactions();
           for( uint32_t trx_num = 0; trx_num < b.transactions.size(); ++trx_num )
           {
              const auto& trx = b.transactions[trx_num];
-             auto id = trx.id();
+             auto id = applied_trxs[trx_num].id;
              auto itr = _callbacks.find(id);
              if( itr != _callbacks.end() )
              {
@@ -323,6 +323,59 @@ namespace detail {
          if( _options->count("resync-blockchain") )
             _chain_db->wipe(_data_dir / "blockchain", true);
 
+         if( _options->count("undo-delta-encoding") )
+            _chain_db->_undo_db.set_delta_encoding( true );
+
+         if( _options->count("state-digest") )
+            _chain_db->enable_state_digest();
+         if( _options->count("verify-speculative-execution") )
+         {
+            if( !_options->count("replay-blockchain") && !_options->count("replay-from-checkpoint") )
+               wlog( "--verify-speculative-execution only checks the blocks of a replay, live blocks are not verified" );
+            _chain_db->enable_speculative_verification();
+         }
+
+         _chain_db->set_block_cache_size( _options->at("block-cache-size").as<uint64_t>() * 1024 * 1024 );
+         _chain_db->set_signature_cache_size( _options->at("signature-cache-size").as<uint64_t>() );
+
+         {
+            const std::string durability = _options->at("block-durability").as<std::string>();
+            chain::block_database::durability_mode mode = chain::block_database::os_buffered;
+            if( durability == "block" )
+               mode = chain::block_database::sync_every_block;
+            else if( durability == "interval" )
+               mode = chain::block_database::sync_interval;
+            else if( durability == "irreversible" )
+               mode = chain::block_database::sync_irreversible;
+            else
+               FC_ASSERT( durability == "os", "Unknown block-durability ${d}", ("d",durability) );
+            _chain_db->set_block_durability( mode, _options->at("block-sync-interval").as<uint32_t>() );
+         }
+
+         if( _options->count("block-compression") )
+            _chain_db->set_block_compression( true );
+
+         if( _options->count("transaction-history") )
+            _chain_db->set_transaction_history( true );
+
+         _chain_db->set_replay_threads( _options->at("replay-threads").as<uint32_t>() );
+         _chain_db->set_worker_threads( _options->at("worker-threads").as<uint32_t>() );
+         _chain_db->set_replay_checkpoint_interval( _options->at("replay-checkpoint-interval").as<uint32_t>() );
+
+         if( _options->count("prune-blocks") || _options->count("prune-irreversible-margin") )
+         {
+            optional<uint32_t> margin;
+            if( _options->count("prune-irreversible-margin") )
+               margin = _options->at("prune-irreversible-margin").as<uint32_t>();
+            _chain_db->set_block_pruning( _options->count("prune-blocks") ? _options->at("prune-blocks").as<uint32_t>() : 0, margin );
+         }
+
+         if( _options->count("enable-journal") )
+         {
+            _chain_db->enable_journal( _options->at("journal-sync-blocks").as<uint32_t>() );
+            _chain_db->set_checkpoint_interval( _options->at("checkpoint-interval").as<uint32_t>() );
+         }
+
          flat_map<uint32_t,block_id_type> loaded_checkpoints;
          if( _options->count("checkpoint") )
          {
@@ -340,6 +393,12 @@ namespace detail {
          {
             ilog("Replaying blockchain on user request.");
             _chain_db->reindex(_data_dir/"blockchain", initial_state());
+         } else if( _options->count("replay-from-checkpoint") ) {
+            ilog("Replaying blockchain from the last replay checkpoint on user request.");
+            _chain_db->reindex(_data_dir/"blockchain", initial_state(), true);
+         } else if( chain::database::has_replay_checkpoint( _data_dir / "blockchain" ) ) {
+            wlog("Detected an interrupted replay. Resuming it from its last checkpoint...");
+            _chain_db->reindex(_data_dir/"blockchain", initial_state(), true);
          } else if( clean ) {
 
             auto is_new = [&]() -> bool
@@ -380,6 +439,18 @@ namespace detail {
             } else {
               _chain_db->open(_data_dir / "blockchain", initial_state);
             }
+         } else if( _chain_db->journal_enabled() &&
+                    fc::exists( _data_dir / "blockchain" / "object_database" / "journal" ) ) {
+            wlog("Detected unclean shutdown. Recovering from the change journal...");
+            try {
+               _chain_db->open(_data_dir / "blockchain", initial_state);
+            } catch( const fc::exception& e ) {
+               // the journal is removed so that the next start falls back to replaying the blockchain
+               elog("Unable to recover from the change journal, restart to replay the blockchain: ${e}",
+                    ("e", e.to_detail_string()));
+               fc::remove_all( _data_dir / "blockchain" / "object_database" / "journal" );
+               throw;
+            }
          } else {
             wlog("Detected unclean shutdown. Replaying blockchain...");
             _chain_db->reindex(_data_dir / "blockchain", initial_state());
@@ -615,13 +686,15 @@ namespace detail {
         // ilog("Request for item ${id}", ("id", id));
          if( id.item_type == graphene::net::block_message_type )
          {
-            auto opt_block = _chain_db->fetch_block_by_id(id.item_hash);
-            if( !opt_block )
+            auto packed_block = _chain_db->fetch_packed_block_by_id(id.item_hash);
+            if( !packed_block )
                elog("Couldn't find block ${id} -- corresponding ID in our chain is ${id2}",
                     ("id", id.item_hash)("id2", _chain_db->get_block_id_for_num(block_header::num_from_id(id.item_hash))));
-            FC_ASSERT( opt_block.valid() );
-            // ilog("Serving up block #${num}", ("num", opt_block->block_num()));
-            return block_message(std::move(*opt_block));
+            FC_ASSERT( packed_block.valid() );
+            // a block_message is the packed block followed by its id, so the stored bytes are sent as they are
+            const block_id_type& block_id = id.item_hash;
+            packed_block->insert( packed_block->end(), block_id.data(), block_id.data() + block_id.data_size() );
+            return message( graphene::net::block_message_type, std::move(*packed_block) );
          }
          return trx_message( _chain_db->get_recent_transaction( id.item_hash ) );
       } FC_CAPTURE_AND_RETHROW( (id) ) }
@@ -917,6 +990,23 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("genesis-json", bpo::value<boost::filesystem::path>(), "File to read Genesis State from")
          ("dbg-init-key", bpo::value<string>(), "Block signing key to use for init witnesses, overrides genesis file")
          ("api-access", bpo::value<boost::filesystem::path>(), "JSON file specifying API permissions")
+         ("enable-journal", "Journal object database changes so that an unclean shutdown does not require a replay")
+         ("journal-sync-blocks", bpo::value<uint32_t>()->default_value(1), "Flush the change journal to disk every N blocks, 0 leaves flushing to the operating system")
+         ("checkpoint-interval", bpo::value<uint32_t>()->default_value(10000), "Number of blocks between object database checkpoints while the change journal is enabled")
+         ("undo-delta-encoding", "Keep undo history as binary diffs of modified objects, using less memory for more CPU")
+         ("state-digest", "Maintain a digest of the consensus state and log it after every block")
+         ("verify-speculative-execution", "While replaying, also apply the transactions of every block in the order of a parallel schedule and check that the state digest matches, implies --state-digest")
+         ("block-cache-size", bpo::value<uint64_t>()->default_value(32), "Megabytes of recently read blocks to keep in memory, 0 disables the cache")
+         ("signature-cache-size", bpo::value<uint64_t>()->default_value(100000), "Number of transactions whose signing keys are kept in memory, 0 disables the cache")
+         ("block-durability", bpo::value<string>()->default_value("os"), "When stored blocks are synced to disk: os (left to the operating system), block (before a block is accepted), interval (every block-sync-interval) or irreversible (when they become irreversible)")
+         ("block-sync-interval", bpo::value<uint32_t>()->default_value(1000), "Milliseconds between syncs of the block database with block-durability=interval")
+         ("block-compression", "Compress stored blocks in the background once they are out of reach of forks, including blocks stored before")
+         ("prune-blocks", bpo::value<uint32_t>(), "Delete blocks from disk except for the last N, the node can no longer serve or replay older history")
+         ("prune-irreversible-margin", bpo::value<uint32_t>(), "Delete blocks from disk more than N blocks below the last irreversible block")
+         ("replay-checkpoint-interval", bpo::value<uint32_t>()->default_value(100000), "Save the state every N blocks of a replay so that an interrupted replay can be resumed, 0 disables this")
+         ("replay-threads", bpo::value<uint32_t>()->default_value(0), "Threads reading and decoding blocks ahead of a replay, 0 picks a number from the available cores")
+         ("worker-threads", bpo::value<uint32_t>()->default_value(0), "Threads hashing and validating the transactions of incoming blocks, 1 disables this, 0 uses every core")
+         ("transaction-history", "Index the ids of all transactions on disk so that get_transaction_location can find them after they expired")
          ;
    command_line_options.add(configuration_file_options);
    command_line_options.add_options()
@@ -925,6 +1015,7 @@ void application::set_program_options(boost::program_options::options_descriptio
           "missing fields in a Genesis State will be added, and any unknown fields will be removed. If no file or an "
           "invalid file is found, it will be replaced with an example Genesis State.")
          ("replay-blockchain", "Rebuild object graph by replaying all blocks")
+         ("replay-from-checkpoint", "Rebuild object graph by replaying blocks, continuing an interrupted replay from its last checkpoint")
          ("resync-blockchain", "Delete all blocks and re-sync with network from scratch")
          ("force-validate", "Force validation of all transactions")
          ("genesis-timestamp", bpo::value<uint32_t>(), "Replace timestamp from genesis.json with current time plus this many seconds (experts only!)")
@@ -56,6 +56,7 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       optional<block_header> get_block_header(uint32_t block_num)const;
       optional<signed_block> get_block(uint32_t block_num)const;
       processed_transaction get_transaction( uint32_t block_num, uint32_t trx_in_block )const;
+      optional<transaction_location> get_transaction_location( const transaction_id_type& id )const;
 
       // Globals
       chain_property_object get_chain_properties()const;
@@ -63,6 +64,11 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       fc::variant_object get_config()const;
       chain_id_type get_chain_id()const;
       dynamic_global_property_object get_dynamic_global_properties()const;
+      state_digest_record get_state_digest()const;
+      block_cache_stats get_block_cache_stats()const;
+      block_store_stats get_block_store_stats()const;
+      signature_cache_stats get_signature_cache_stats()const;
+      vector<index_pool_stats> get_index_pool_stats()const;
 
       // Keys
       vector<vector<account_id_type>> get_key_references( vector<public_key_type> key )const;
@@ -350,6 +356,16 @@ processed_transaction database_api_impl::get_transaction(uint32_t block_num, uin
    return opt_block->transactions[trx_num];
 }
 
+optional<transaction_location> database_api::get_transaction_location( const transaction_id_type& id )const
+{
+   return my->get_transaction_location( id );
+}
+
+optional<transaction_location> database_api_impl::get_transaction_location( const transaction_id_type& id )const
+{
+   return _db.get_transaction_location( id );
+}
+
 //////////////////////////////////////////////////////////////////////
 //                                                                  //
 // Globals                                                          //
@@ -406,6 +422,56 @@ dynamic_global_property_object database_api_impl::get_dynamic_global_properties(
    return _db.get(dynamic_global_property_id_type());
 }
 
+state_digest_record database_api::get_state_digest()const
+{
+   return my->get_state_digest();
+}
+
+state_digest_record database_api_impl::get_state_digest()const
+{
+   return _db.get_state_digest();
+}
+
+block_cache_stats database_api::get_block_cache_stats()const
+{
+   return my->get_block_cache_stats();
+}
+
+block_cache_stats database_api_impl::get_block_cache_stats()const
+{
+   return _db.get_block_cache_stats();
+}
+
+block_store_stats database_api::get_block_store_stats()const
+{
+   return my->get_block_store_stats();
+}
+
+block_store_stats database_api_impl::get_block_store_stats()const
+{
+   return _db.get_block_store_stats();
+}
+
+signature_cache_stats database_api::get_signature_cache_stats()const
+{
+   return my->get_signature_cache_stats();
+}
+
+signature_cache_stats database_api_impl::get_signature_cache_stats()const
+{
+   return _db.get_signature_cache_stats();
+}
+
+vector<index_pool_stats> database_api::get_index_pool_stats()const
+{
+   return my->get_index_pool_stats();
+}
+
+vector<index_pool_stats> database_api_impl::get_index_pool_stats()const
+{
+   return _db.get_index_pool_stats();
+}
+
 //////////////////////////////////////////////////////////////////////
 //                                                                  //
 // Keys                                                             //
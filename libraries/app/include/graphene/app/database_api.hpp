@@ -128,6 +128,12 @@ class database_api
        */
       optional<signed_transaction> get_recent_transaction_by_id( const transaction_id_type& id )const;
 
+      /**
+       * @brief Find the block and position of a transaction, which can then be fetched with get_transaction
+       * @return null if the node does not run with transaction-history or the transaction is unknown
+       */
+      optional<transaction_location> get_transaction_location( const transaction_id_type& id )const;
+
       /////////////
       // Globals //
       /////////////
@@ -157,6 +163,36 @@ class database_api
        */
       dynamic_global_property_object get_dynamic_global_properties()const;
 
+      /**
+       * @brief Retrieve the digest of the consensus state after the head block, only maintained by nodes
+       * started with --state-digest
+       */
+      state_digest_record get_state_digest()const;
+
+      /**
+       * @brief Retrieve the hit and miss counters and the occupancy of the cache of blocks read from disk
+       */
+      block_cache_stats get_block_cache_stats()const;
+
+      /**
+       * @brief Retrieve the latency of storing blocks and of syncing them to disk
+       */
+      block_store_stats get_block_store_stats()const;
+
+      /**
+       * @brief Retrieve the hit and miss counters and the occupancy of the cache of transaction signing keys
+       */
+      signature_cache_stats get_signature_cache_stats()const;
+
+      /**
+       * @brief Retrieve the occupancy of the node pools of the object indexes which allocate from one
+       *
+       * A node pool is a process wide singleton per object type, so with several databases in one process the
+       * figures include the objects of all of them.  The pools are not synchronized, they are only read here
+       * and every pooled index must only be modified from the chain thread.
+       */
+      vector<index_pool_stats> get_index_pool_stats()const;
+
       //////////
       // Keys //
       //////////
@@ -488,6 +524,7 @@ FC_API(graphene::app::database_api,
    (get_block)
    (get_transaction)
    (get_recent_transaction_by_id)
+   (get_transaction_location)
 
    // Globals
    (get_chain_properties)
@@ -495,6 +532,11 @@ FC_API(graphene::app::database_api,
    (get_config)
    (get_chain_id)
    (get_dynamic_global_properties)
+   (get_state_digest)
+   (get_block_cache_stats)
+   (get_block_store_stats)
+   (get_signature_cache_stats)
+   (get_index_pool_stats)
 
    // Keys
    (get_key_references)
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <graphene/chain/block_cache.hpp>
+
+namespace graphene { namespace chain {
+
+block_cache::block_cache( uint64_t capacity )
+{
+   _stats.capacity = capacity;
+}
+
+void block_cache::set_capacity( uint64_t capacity )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _stats.capacity = capacity;
+   evict();
+}
+
+uint64_t block_cache::capacity()const
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   return _stats.capacity;
+}
+
+block_cache::entry* block_cache::touch( uint32_t block_num, const block_id_type& id )
+{
+   auto itr = _by_num.find( block_num );
+   if( itr == _by_num.end() || itr->second->id != id )
+      return nullptr;
+   _lru.splice( _lru.begin(), _lru, itr->second );
+   return &_lru.front();
+}
+
+std::shared_ptr<const signed_block> block_cache::fetch_block( uint32_t block_num, const block_id_type& id )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   if( _stats.capacity == 0 )
+      return std::shared_ptr<const signed_block>();
+   entry* e = touch( block_num, id );
+   if( e == nullptr || !e->block )
+   {
+      ++_stats.misses;
+      return std::shared_ptr<const signed_block>();
+   }
+   ++_stats.hits;
+   return e->block;
+}
+
+std::shared_ptr<const vector<char>> block_cache::fetch_packed( uint32_t block_num, const block_id_type& id )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   if( _stats.capacity == 0 )
+      return std::shared_ptr<const vector<char>>();
+   entry* e = touch( block_num, id );
+   if( e == nullptr )
+   {
+      ++_stats.misses;
+      return std::shared_ptr<const vector<char>>();
+   }
+   ++_stats.hits;
+   return e->packed;
+}
+
+void block_cache::insert( uint32_t block_num, const block_id_type& id,
+                          std::shared_ptr<const vector<char>> packed,
+                          std::shared_ptr<const signed_block> block )
+{
+   FC_ASSERT( packed );
+   std::lock_guard<std::mutex> lock( _mutex );
+   if( _stats.capacity == 0 )
+      return;
+
+   entry* e = touch( block_num, id );
+   if( e == nullptr )
+   {
+      auto itr = _by_num.find( block_num );
+      if( itr != _by_num.end() )
+         erase( itr );
+      _lru.emplace_front();
+      e = &_lru.front();
+      e->block_num = block_num;
+      e->id        = id;
+      e->packed    = std::move( packed );
+      _by_num[block_num] = _lru.begin();
+      ++_stats.entries;
+   }
+   else
+   {
+      _stats.size -= e->size();
+   }
+   if( block && !e->block )
+      e->block = std::move( block );
+   _stats.size += e->size();
+   evict();
+}
+
+void block_cache::erase( uint32_t block_num )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   auto itr = _by_num.find( block_num );
+   if( itr != _by_num.end() )
+      erase( itr );
+}
+
+void block_cache::erase( std::unordered_map<uint32_t, lru_list::iterator>::iterator itr )
+{
+   _stats.size -= itr->second->size();
+   --_stats.entries;
+   _lru.erase( itr->second );
+   _by_num.erase( itr );
+}
+
+void block_cache::evict()
+{
+   while( _stats.size > _stats.capacity && !_lru.empty() )
+      erase( _by_num.find( _lru.back().block_num ) );
+}
+
+void block_cache::clear()
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _lru.clear();
+   _by_num.clear();
+   _stats.entries = 0;
+   _stats.size    = 0;
+}
+
+block_cache_stats block_cache::stats()const
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   return _stats;
+}
+
+} }
@@ -20,9 +20,29 @@
  */
 #include <graphene/chain/block_database.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/smart_ref_impl.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#include <zlib.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace graphene { namespace chain {
 
 struct index_entry
@@ -36,39 +56,782 @@ FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(block_id) );
 
 namespace graphene { namespace chain {
 
+/**
+ *  A compressed segment stores runs of consecutive blocks as zlib frames listed in its "frames-N" file.  The index
+ *  entry of a block in a frame has framed_flag set in block_pos, followed by the number of the frame in the upper
+ *  and the offset of the block in the uncompressed frame in the lower 32 bits.  Its block_size stays the size of
+ *  the uncompressed block.
+ */
+struct frame_entry
+{
+   uint64_t pos             = 0; ///< offset of the compressed frame in blocks
+   uint32_t compressed_size = 0;
+   uint32_t raw_size        = 0;
+};
+
+static const uint64_t framed_flag = uint64_t(1) << 63;
+// blocks are collected into frames of about this size before they are compressed
+static const uint32_t frame_target_size = 64 * 1024;
+
+static uint32_t frame_of( const index_entry& e ) { return uint32_t( (e.block_pos & ~framed_flag) >> 32 ); }
+
+/**
+ *  Every block which is not in a frame is preceded by its size and a CRC-32 of its id and data.  An index entry
+ *  points at this header, so a torn block and an entry which was written without its block are both detected.
+ */
+struct record_header
+{
+   uint32_t size     = 0;
+   uint32_t checksum = 0;
+};
+static_assert( sizeof(record_header) == block_database::record_header_size, "record_header must not be padded" );
+
+static uint32_t record_checksum( const block_id_type& id, const char* data, size_t size )
+{
+   uLong crc = crc32( 0, Z_NULL, 0 );
+   crc = crc32( crc, (const Bytef*)id.data(), id.data_size() );
+   return crc32( crc, (const Bytef*)data, size );
+}
+
+struct block_segment
+{
+   block_segment( const fc::path& dir, uint32_t number, uint32_t blocks_per_segment );
+   ~block_segment();
+
+   index_entry& entry( uint32_t block_num ) { return entries[block_num % size]; }
+   /** hands pending data to the operating system, the mutex must be held */
+   void write_pending();
+   /** fsyncs both files if they changed since the last call */
+   void sync();
+   /** @return the data of the block described by e, the mutex must be held */
+   vector<char> read( const index_entry& e );
+   /** @return true if the block described by e is complete and matches its checksum, the mutex must be held */
+   bool verify( const index_entry& e );
+   /** cuts the blocks file to new_size, the mutex must be held and nothing may be pending */
+   void truncate( uint64_t new_size );
+   /** writes frames to frames_path, or removes the file if there are none */
+   void save_frames();
+   /** @return true if the blocks file holds data which is not in a frame */
+   bool has_raw_data()const { return frames.empty() ? file_size > 0 : file_size > frames.back().pos + frames.back().compressed_size; }
+
+   const uint32_t                       number;
+   const uint32_t                       size;
+   fc::path                             blocks_path;
+   fc::path                             index_path;
+   fc::path                             frames_path;
+   std::unique_ptr<fc::mapped_region>   index_region;
+   index_entry*                         entries = nullptr;
+   /** serializes access to blocks and changes of entries */
+   std::mutex                           mutex;
+   std::fstream                         blocks;
+   uint64_t                             file_size = 0; ///< bytes written to blocks, pending data follows at this offset
+   std::vector<char>                    pending;       ///< appended data which was not written yet
+   std::atomic<bool>                    has_pending;
+   std::atomic<bool>                    unsynced;
+   std::vector<frame_entry>             frames;
+   /** the last frame which was decompressed, blocks are mostly read in order */
+   uint32_t                             cached_frame = uint32_t(-1);
+   std::vector<char>                    cached_frame_data;
+   /** set when the segment was pruned, its files are deleted with the last reference */
+   std::atomic<bool>                    dropped;
+};
+
+struct segment_table
+{
+   uint32_t                                        first = 0; ///< number of segments[0]
+   std::vector< std::shared_ptr<block_segment> >   segments;  ///< null where no block was stored yet
+};
+
+static void sync_file( const fc::path& p )
+{
+#ifdef _WIN32
+   HANDLE h = CreateFileW( p.generic_wstring().c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+   FC_ASSERT( h != INVALID_HANDLE_VALUE, "Unable to open ${p} for syncing", ("p",p) );
+   const bool ok = FlushFileBuffers( h );
+   CloseHandle( h );
+#else
+   // fsync applies to the file, not to the descriptor, so it also covers writes made through the fstream and the mapping
+   const int fd = ::open( p.generic_string().c_str(), O_RDONLY );
+   FC_ASSERT( fd >= 0, "Unable to open ${p} for syncing", ("p",p) );
+   const bool ok = ::fsync( fd ) == 0;
+   ::close( fd );
+#endif
+   FC_ASSERT( ok, "Unable to sync ${p}", ("p",p) );
+}
+
+static std::string segment_suffix( uint32_t first_block_num )
+{
+   char buf[16];
+   snprintf( buf, sizeof(buf), "%010u", first_block_num );
+   return buf;
+}
+
+static vector<char> compress_frame( const vector<char>& raw )
+{
+   uLongf size = compressBound( raw.size() );
+   vector<char> result( size );
+   FC_ASSERT( compress2( (Bytef*)result.data(), &size, (const Bytef*)raw.data(), raw.size(), Z_DEFAULT_COMPRESSION ) == Z_OK );
+   result.resize( size );
+   return result;
+}
+
+/**
+ *  Compaction writes the new blocks file and a journal of the updated index entries and frames next to the segment
+ *  before it replaces anything.  Once the journal exists the compaction is completed here after a crash,
+ *  otherwise the partially written blocks file is discarded.
+ */
+static void recover_compaction( block_segment& seg )
+{
+   const fc::path data_tmp( seg.blocks_path.generic_string() + ".compact" );
+   const fc::path journal( seg.index_path.generic_string() + ".compact" );
+   if( fc::exists( journal ) )
+   {
+      const uint64_t index_bytes = uint64_t(seg.size) * sizeof(index_entry);
+      const uint64_t journal_size = fc::file_size( journal );
+      FC_ASSERT( journal_size >= index_bytes && (journal_size - index_bytes) % sizeof(frame_entry) == 0,
+                 "Truncated compaction journal ${j}", ("j",journal) );
+      if( fc::exists( data_tmp ) )
+         fc::rename( data_tmp, seg.blocks_path );
+      std::ifstream in( journal.generic_string().c_str(), std::ifstream::binary );
+      in.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+      in.read( (char*)seg.entries, index_bytes );
+      seg.frames.resize( (journal_size - index_bytes) / sizeof(frame_entry) );
+      if( !seg.frames.empty() )
+         in.read( (char*)seg.frames.data(), seg.frames.size() * sizeof(frame_entry) );
+      in.close();
+      seg.save_frames();
+      seg.index_region->flush();
+      wlog( "Completed the interrupted compaction of ${f}", ("f",seg.blocks_path) );
+   }
+   fc::remove( data_tmp );
+   fc::remove( journal );
+}
+
+block_segment::block_segment( const fc::path& dir, uint32_t n, uint32_t blocks_per_segment )
+:number(n),size(blocks_per_segment),has_pending(false),unsynced(false),dropped(false)
+{
+   const std::string suffix = segment_suffix( n * blocks_per_segment );
+   blocks_path = dir / ("blocks-" + suffix);
+   index_path  = dir / ("index-" + suffix);
+   frames_path = dir / ("frames-" + suffix);
+
+   const uint64_t index_bytes = uint64_t(size) * sizeof(index_entry);
+   if( !fc::exists( index_path ) )
+      std::ofstream( index_path.generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
+   if( fc::file_size( index_path ) != index_bytes )
+      fc::resize_file( index_path, index_bytes );
+   fc::file_mapping file( index_path.generic_string().c_str(), fc::read_write );
+   index_region.reset( new fc::mapped_region( file, fc::read_write, 0, index_bytes ) );
+   entries = static_cast<index_entry*>( index_region->get_address() );
+
+   if( fc::exists( frames_path ) )
+   {
+      frames.resize( fc::file_size( frames_path ) / sizeof(frame_entry) );
+      std::ifstream in( frames_path.generic_string().c_str(), std::ifstream::binary );
+      in.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+      if( !frames.empty() )
+         in.read( (char*)frames.data(), frames.size() * sizeof(frame_entry) );
+   }
+   recover_compaction( *this );
+
+   auto mode = std::fstream::binary | std::fstream::in | std::fstream::out;
+   if( !fc::exists( blocks_path ) )
+      mode |= std::fstream::trunc;
+   blocks.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+   blocks.open( blocks_path.generic_string().c_str(), mode );
+   blocks.seekg( 0, blocks.end );
+   file_size = blocks.tellg();
+}
+
+void block_segment::write_pending()
+{
+   if( pending.empty() )
+      return;
+   blocks.seekp( file_size );
+   blocks.write( pending.data(), pending.size() );
+   blocks.flush();
+   file_size += pending.size();
+   pending.clear();
+   has_pending = false;
+   unsynced = true;
+}
+
+/**
+ *  @return the data of the block described by e from the blocks file, frame and frame_data cache the last frame
+ *  which was decompressed
+ */
+static vector<char> read_stored( std::istream& blocks, const index_entry& e, const std::vector<frame_entry>& frames,
+                                 uint32_t& frame, vector<char>& frame_data, const fc::path& blocks_path )
+{
+   if( !(e.block_pos & framed_flag) )
+   {
+      record_header h;
+      vector<char> data( e.block_size );
+      blocks.seekg( e.block_pos );
+      blocks.read( (char*)&h, sizeof(h) );
+      blocks.read( data.data(), data.size() );
+      FC_ASSERT( h.size == e.block_size && h.checksum == record_checksum( e.block_id, data.data(), data.size() ),
+                 "Corrupt block ${id} in ${f}", ("id",e.block_id)("f",blocks_path) );
+      return data;
+   }
+
+   const uint32_t n = frame_of( e );
+   const uint32_t offset = uint32_t( e.block_pos );
+   FC_ASSERT( n < frames.size(), "Missing frame ${n} of ${f}", ("n",n)("f",blocks_path) );
+   if( n != frame )
+   {
+      const frame_entry& f = frames[n];
+      vector<char> compressed( f.compressed_size );
+      blocks.seekg( f.pos );
+      blocks.read( compressed.data(), compressed.size() );
+      frame = uint32_t(-1);
+      frame_data.resize( f.raw_size );
+      uLongf size = f.raw_size;
+      FC_ASSERT( uncompress( (Bytef*)frame_data.data(), &size, (const Bytef*)compressed.data(), compressed.size() ) == Z_OK
+                 && size == f.raw_size, "Corrupt frame ${n} of ${f}", ("n",n)("f",blocks_path) );
+      frame = n;
+   }
+   FC_ASSERT( uint64_t(offset) + e.block_size <= frame_data.size() );
+   return vector<char>( frame_data.begin() + offset, frame_data.begin() + offset + e.block_size );
+}
+
+vector<char> block_segment::read( const index_entry& e )
+{
+   if( !(e.block_pos & framed_flag) && e.block_pos >= file_size )
+   {
+      record_header h;
+      vector<char> data( e.block_size );
+      const char* record = pending.data() + (e.block_pos - file_size);
+      std::memcpy( (char*)&h, record, sizeof(h) );
+      std::memcpy( data.data(), record + sizeof(h), data.size() );
+      FC_ASSERT( h.size == e.block_size && h.checksum == record_checksum( e.block_id, data.data(), data.size() ),
+                 "Corrupt block ${id} in ${f}", ("id",e.block_id)("f",blocks_path) );
+      return data;
+   }
+   return read_stored( blocks, e, frames, cached_frame, cached_frame_data, blocks_path );
+}
+
+bool block_segment::verify( const index_entry& e )
+{
+   // frames are synced before their segment is switched over to them, zlib checks their contents when they are read
+   if( e.block_pos & framed_flag )
+      return frame_of( e ) < frames.size();
+   if( e.block_pos + sizeof(record_header) + e.block_size > file_size + pending.size() )
+      return false;
+   try
+   {
+      read( e );
+      return true;
+   }
+   catch( const fc::exception& )
+   {
+      return false;
+   }
+   catch( const std::exception& )
+   {
+      return false;
+   }
+}
+
+void block_segment::truncate( uint64_t new_size )
+{
+   blocks.close();
+   fc::resize_file( blocks_path, new_size );
+   blocks.open( blocks_path.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+   file_size = new_size;
+   unsynced = true;
+}
+
+void block_segment::save_frames()
+{
+   cached_frame = uint32_t(-1);
+   if( frames.empty() )
+   {
+      fc::remove( frames_path );
+      return;
+   }
+   {
+      std::ofstream out( frames_path.generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
+      out.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+      out.write( (const char*)frames.data(), frames.size() * sizeof(frame_entry) );
+   }
+   sync_file( frames_path );
+}
+
+void block_segment::sync()
+{
+   if( !unsynced.exchange( false ) )
+      return;
+   sync_file( blocks_path );
+   sync_file( index_path );
+}
+
+block_segment::~block_segment()
+{
+   try
+   {
+      if( !dropped && blocks.is_open() )
+         write_pending();
+      if( blocks.is_open() )
+         blocks.close();
+      if( !dropped )
+         index_region->flush();
+      index_region.reset();
+      if( dropped )
+      {
+         fc::remove( blocks_path );
+         fc::remove( index_path );
+         fc::remove( frames_path );
+      }
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Error closing block segment ${f}: ${e}", ("f",blocks_path)("e",e.to_detail_string()) );
+   }
+   catch( const std::exception& e )
+   {
+      wlog( "Error closing block segment ${f}: ${e}", ("f",blocks_path)("e",e.what()) );
+   }
+}
+
+block_database::block_database( uint32_t blocks_per_segment )
+:_blocks_per_segment(blocks_per_segment),_index_size(0),_index_seq(0),_compress_segments(false),_cache(default_cache_size){}
+
+block_database::~block_database()
+{
+   close();
+}
+
 void block_database::open( const fc::path& dbdir )
 { try {
    fc::create_directories(dbdir);
-   _block_num_to_pos.exceptions(std::ios_base::failbit | std::ios_base::badbit);
-   _blocks.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+   _dir = dbdir;
+
+   std::vector<uint32_t> firsts;
+   for( fc::directory_iterator itr( dbdir ), end; itr != end; ++itr )
+   {
+      const std::string name = (*itr).filename().generic_string();
+      if( name.size() == 16 && name.compare( 0, 6, "index-" ) == 0 )
+         firsts.push_back( std::stoul( name.substr( 6 ) ) );
+   }
+   std::sort( firsts.begin(), firsts.end() );
+
+   auto table = std::make_shared<segment_table>();
+   if( !firsts.empty() )
+   {
+      // the segment size of an existing log takes precedence over the configured one
+      const uint64_t existing = fc::file_size( dbdir / ("index-" + segment_suffix( firsts.front() )) ) / sizeof(index_entry);
+      FC_ASSERT( existing > 0 && existing <= std::numeric_limits<uint32_t>::max() );
+      if( existing != _blocks_per_segment )
+      {
+         wlog( "Using the segment size ${s} of the existing block log", ("s",existing) );
+         _blocks_per_segment = existing;
+      }
+      table->first = firsts.front() / _blocks_per_segment;
+      for( uint32_t f : firsts )
+      {
+         FC_ASSERT( f % _blocks_per_segment == 0, "Block segment ${f} does not start at a segment boundary", ("f",f) );
+         const uint32_t n = f / _blocks_per_segment;
+         table->segments.resize( n - table->first + 1 );
+         table->segments[n - table->first] = std::make_shared<block_segment>( dbdir, n, _blocks_per_segment );
+      }
+   }
+
+   recover_tail( *table );
 
-   if( !fc::exists( dbdir/"index" ) )
+   // entries past the last stored block are zero
+   uint64_t size = 0;
+   for( auto itr = table->segments.rbegin(); size == 0 && itr != table->segments.rend(); ++itr )
    {
-     _block_num_to_pos.open( (dbdir/"index").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
+      if( !*itr ) continue;
+      for( uint32_t i = _blocks_per_segment; i > 0; --i )
+         if( (*itr)->entries[i-1].block_id != block_id_type() )
+         {
+            size = uint64_t((*itr)->number) * _blocks_per_segment + i;
+            break;
+         }
    }
-   else
+   _index_size.store( size );
+   std::atomic_store( &_segments, std::shared_ptr<const segment_table>( table ) );
+
+   _stop_tasks = false;
+   _background = std::thread( [this]() { run_background_tasks(); } );
    {
-     _block_num_to_pos.open( (dbdir/"index").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+      std::lock_guard<std::mutex> lock( _flush_mutex );
+      _stop_flusher = _flush_failed = _write_requested = _sync_requested = false;
+      _store_stats = block_store_stats();
    }
+   _flusher = std::thread( [this]() { run_flusher(); } );
+   _open = true;
+
+   // segments written before compression was enabled, the last two are left to writable_segment()
+   if( _compress_segments && table->segments.size() > 2 )
+      for( auto itr = table->segments.begin(); itr != table->segments.end() - 2; ++itr )
+         if( *itr && (*itr)->has_raw_data() )
+            schedule( *itr );
+
+   if( fc::exists( dbdir / "index" ) )
+      import_legacy_log( dbdir );
 } FC_CAPTURE_AND_RETHROW( (dbdir) ) }
 
+// the tail check ends once this many bytes of intact blocks were found below the last damaged one
+static const uint64_t recovery_window = 64 * 1024 * 1024;
+
+void block_database::recover_tail( const segment_table& table )
+{
+   const auto start = fc::time_point::now();
+   const uint64_t none = std::numeric_limits<uint64_t>::max();
+   uint64_t top = none;  // one past the newest block
+   uint64_t cut = none;  // the lowest block which is missing or damaged
+   uint64_t intact = 0;
+   uint32_t checked = 0;
+   for( auto itr = table.segments.rbegin(); itr != table.segments.rend() && intact < recovery_window; ++itr )
+   {
+      if( !*itr ) continue;
+      block_segment& seg = **itr;
+      for( uint32_t i = seg.size; i > 0 && intact < recovery_window; --i )
+      {
+         const uint64_t num = uint64_t(seg.number) * seg.size + i - 1;
+         const index_entry& e = seg.entries[i-1];
+         if( top == none )
+         {
+            // removed blocks above the newest one are left overs of forks
+            if( e.block_size == 0 ) continue;
+            top = num + 1;
+         }
+         if( num == 0 )
+            break;
+         ++checked;
+         if( e.block_size == 0 || block_header::num_from_id( e.block_id ) != num || !seg.verify( e ) )
+         {
+            cut = num;
+            intact = 0;
+            continue;
+         }
+         // a compressed segment was synced as a whole, so is everything below it
+         if( e.block_pos & framed_flag )
+            intact = recovery_window;
+         intact += sizeof(record_header) + e.block_size;
+      }
+   }
+
+   if( cut == none )
+   {
+      ilog( "Checked the last ${n} blocks of the block log in ${t} ms",
+            ("n",checked)("t",(fc::time_point::now() - start).count() / 1000) );
+      return;
+   }
+
+   wlog( "Block ${c} is missing or damaged, dropping blocks ${c} to ${l} from the block log",
+         ("c",cut)("l",top - 1) );
+   for( const auto& seg : table.segments )
+   {
+      if( !seg || uint64_t(seg->number + 1) * seg->size <= cut )
+         continue;
+      uint64_t end = seg->frames.empty() ? 0 : seg->frames.back().pos + seg->frames.back().compressed_size;
+      for( uint32_t i = 0; i < seg->size; ++i )
+      {
+         index_entry& e = seg->entries[i];
+         if( uint64_t(seg->number) * seg->size + i >= cut )
+            e = index_entry();
+         else if( e.block_size > 0 && !(e.block_pos & framed_flag) )
+            end = std::max( end, e.block_pos + sizeof(record_header) + e.block_size );
+      }
+      // whatever follows the last intact block was written by the interrupted run
+      if( end < seg->file_size )
+         seg->truncate( end );
+      seg->index_region->flush();
+      seg->unsynced = true;
+      seg->sync();
+   }
+}
+
+void block_database::import_legacy_log( const fc::path& dbdir )
+{
+   const fc::path index_path  = dbdir / "index";
+   const fc::path blocks_path = dbdir / "blocks";
+   const uint64_t count = fc::file_size( index_path ) / sizeof(index_entry);
+   ilog( "Converting ${n} index entries in ${d} to block segments", ("n",count)("d",dbdir) );
+   {
+      std::ifstream index( index_path.generic_string().c_str(), std::ifstream::binary );
+      std::ifstream blocks( blocks_path.generic_string().c_str(), std::ifstream::binary );
+      index.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+      blocks.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+
+      index_entry e;
+      vector<char> data;
+      for( uint64_t num = 0; num < count; ++num )
+      {
+         index.read( (char*)&e, sizeof(e) );
+         if( e.block_size == 0 || e.block_id == block_id_type() )
+            continue;
+         data.resize( e.block_size );
+         blocks.seekg( e.block_pos );
+         blocks.read( data.data(), data.size() );
+         append( num, e.block_id, data );
+         if( num % 100000 == 0 )
+            ilog( "   ${n} of ${c}", ("n",num)("c",count) );
+      }
+   }
+   flush();
+   // an interrupted conversion starts over, blocks which were already appended are overwritten
+   fc::remove( index_path );
+   fc::remove( blocks_path );
+}
+
 bool block_database::is_open()const
 {
-  return _blocks.is_open();
+  return _open;
 }
 
 void block_database::close()
 {
-  _blocks.close();
-  _block_num_to_pos.close();
+  if( !is_open() ) return;
+  {
+     std::lock_guard<std::mutex> lock( _flush_mutex );
+     _stop_flusher = true;
+  }
+  _flush_cv.notify_all();
+  _flusher.join();
+  {
+     std::lock_guard<std::mutex> lock( _tasks_mutex );
+     _stop_tasks = true;
+  }
+  _tasks_cv.notify_all();
+  _background.join();
+
+  flush();
+  std::atomic_store( &_segments, std::shared_ptr<const segment_table>() );
+  _cache.clear();
+  _index_size.store( 0 );
+  _open = false;
 }
 
 void block_database::flush()
 {
-  _blocks.flush();
-  _block_num_to_pos.flush();
+  auto table = std::atomic_load( &_segments );
+  if( !table ) return;
+  for( const auto& seg : table->segments )
+  {
+     if( !seg ) continue;
+     std::lock_guard<std::mutex> lock( seg->mutex );
+     seg->write_pending();
+     seg->index_region->flush();
+  }
+}
+
+void block_database::set_durability( durability_mode mode, uint32_t sync_interval_ms )
+{
+   {
+      std::lock_guard<std::mutex> lock( _flush_mutex );
+      _durability = mode;
+      _sync_interval_ms = std::max<uint32_t>( sync_interval_ms, 1 );
+   }
+   _flush_cv.notify_all();
+}
+
+void block_database::sync()
+{
+   std::unique_lock<std::mutex> lock( _flush_mutex );
+   FC_ASSERT( _open && !_stop_flusher, "block database is not open" );
+   // the first round started after this request writes everything stored before it
+   const uint64_t round = _sync_rounds_started + 1;
+   _sync_requested = true;
+   _flush_cv.notify_all();
+   _flushed_cv.wait( lock, [&]() { return _sync_rounds_done >= round || _flush_failed; } );
+   FC_ASSERT( !_flush_failed, "Writing the block database failed, see the log for details" );
+}
+
+void block_database::request_sync()
+{
+   {
+      std::lock_guard<std::mutex> lock( _flush_mutex );
+      _sync_requested = true;
+   }
+   _flush_cv.notify_all();
+}
+
+block_store_stats block_database::store_stats()const
+{
+   std::lock_guard<std::mutex> lock( _flush_mutex );
+   return _store_stats;
+}
+
+void block_database::run_flusher()
+{
+   std::unique_lock<std::mutex> lock( _flush_mutex );
+   while( true )
+   {
+      auto ready = [this]() { return _stop_flusher || _write_requested || _sync_requested; };
+      if( _durability == sync_interval )
+         _flush_cv.wait_for( lock, std::chrono::milliseconds( _sync_interval_ms ), ready );
+      else
+         _flush_cv.wait( lock, ready );
+
+      const bool stop = _stop_flusher;
+      const bool sync = _sync_requested || _durability == sync_interval || ( stop && _durability != os_buffered );
+      const uint64_t round = sync ? ++_sync_rounds_started : 0;
+      _write_requested = _sync_requested = false;
+      _store_stats.pending_bytes = 0;
+      lock.unlock();
+
+      const auto start = fc::time_point::now();
+      bool failed = false;
+      try
+      {
+         write_segments( sync );
+      }
+      catch( const fc::exception& e )
+      {
+         elog( "Error writing the block database: ${e}", ("e",e.to_detail_string()) );
+         failed = true;
+      }
+      catch( const std::exception& e )
+      {
+         elog( "Error writing the block database: ${e}", ("e",e.what()) );
+         failed = true;
+      }
+      const uint64_t elapsed = (fc::time_point::now() - start).count();
+
+      lock.lock();
+      ++_store_stats.writes;
+      if( sync )
+      {
+         ++_store_stats.syncs;
+         _store_stats.sync_time_us += elapsed;
+         _store_stats.max_sync_time_us = std::max( _store_stats.max_sync_time_us, elapsed );
+         _sync_rounds_done = round;
+      }
+      _flush_failed = _flush_failed || failed;
+      _flushed_cv.notify_all();
+      if( stop )
+         return;
+   }
+}
+
+void block_database::write_segments( bool sync )
+{
+   auto table = std::atomic_load( &_segments );
+   if( !table )
+      return;
+   for( const auto& seg : table->segments )
+   {
+      if( !seg || !seg->has_pending )
+         continue;
+      std::lock_guard<std::mutex> lock( seg->mutex );
+      seg->write_pending();
+   }
+   if( sync )
+      for( const auto& seg : table->segments )
+         if( seg )
+            seg->sync();
+}
+
+std::shared_ptr<block_segment> block_database::find_segment( uint32_t block_num )const
+{
+   auto table = std::atomic_load( &_segments );
+   const uint32_t n = block_num / _blocks_per_segment;
+   if( !table || n < table->first || n - table->first >= table->segments.size() )
+      return std::shared_ptr<block_segment>();
+   return table->segments[n - table->first];
+}
+
+std::shared_ptr<block_segment> block_database::writable_segment( uint32_t block_num )
+{
+   if( auto seg = find_segment( block_num ) )
+      return seg;
+
+   std::shared_ptr<block_segment> created;
+   std::shared_ptr<block_segment> to_compact;
+   {
+      std::lock_guard<std::mutex> lock( _write_mutex );
+      auto table = std::atomic_load( &_segments );
+      FC_ASSERT( table, "block database is not open" );
+      const uint32_t n = block_num / _blocks_per_segment;
+      FC_ASSERT( table->segments.empty() || n >= table->first,
+                 "Block ${num} belongs to a pruned segment", ("num",block_num) );
+
+      auto next = std::make_shared<segment_table>( *table );
+      if( next->segments.empty() )
+         next->first = n;
+      if( n - next->first >= next->segments.size() )
+         next->segments.resize( n - next->first + 1 );
+      created = std::make_shared<block_segment>( _dir, n, _blocks_per_segment );
+      next->segments[n - next->first] = created;
+      // blocks two segments behind the head are out of reach of forks, whatever they left behind can go
+      if( n >= next->first + 2 )
+         to_compact = next->segments[n - 2 - next->first];
+      std::atomic_store( &_segments, std::shared_ptr<const segment_table>( next ) );
+   }
+   if( to_compact )
+      schedule( std::move(to_compact) );
+   return created;
+}
+
+std::shared_ptr<block_segment> block_database::read_entry( uint32_t block_num, index_entry& e )const
+{
+   if( block_num >= _index_size.load( std::memory_order_acquire ) )
+      return std::shared_ptr<block_segment>();
+   auto seg = find_segment( block_num );
+   if( !seg )
+      return seg;
+   while( true )
+   {
+      const uint64_t seq = _index_seq.load( std::memory_order_acquire );
+      if( seq & 1 )
+      {
+         std::this_thread::yield();
+         continue;
+      }
+      std::memcpy( (char*)&e, (const char*)&seg->entry( block_num ), sizeof(e) );
+      std::atomic_thread_fence( std::memory_order_acquire );
+      if( _index_seq.load( std::memory_order_relaxed ) == seq )
+         return seg;
+   }
+}
+
+void block_database::write_entry( block_segment& seg, uint32_t block_num, const index_entry& e )
+{
+   _index_seq.fetch_add( 1, std::memory_order_acq_rel );
+   std::atomic_thread_fence( std::memory_order_release );
+   std::memcpy( (char*)&seg.entry( block_num ), (const char*)&e, sizeof(e) );
+   seg.unsynced = true;
+   if( block_num >= _index_size.load( std::memory_order_relaxed ) )
+      _index_size.store( uint64_t(block_num) + 1, std::memory_order_release );
+   _index_seq.fetch_add( 1, std::memory_order_release );
+}
+
+// sync_interval buffers at most this much before the flusher is woken early
+static const uint64_t max_pending_bytes = 16 * 1024 * 1024;
+
+void block_database::append( uint32_t block_num, const block_id_type& id, const vector<char>& data )
+{
+   auto seg = writable_segment( block_num );
+   {
+      index_entry e;
+      record_header h;
+      h.size     = data.size();
+      h.checksum = record_checksum( id, data.data(), data.size() );
+      std::lock_guard<std::mutex> lock( seg->mutex );
+      e.block_pos  = seg->file_size + seg->pending.size();
+      e.block_size = data.size();
+      e.block_id   = id;
+      seg->pending.insert( seg->pending.end(), (const char*)&h, (const char*)&h + sizeof(h) );
+      seg->pending.insert( seg->pending.end(), data.begin(), data.end() );
+      seg->has_pending = true;
+
+      std::lock_guard<std::mutex> write_lock( _write_mutex );
+      write_entry( *seg, block_num, e );
+   }
+
+   std::lock_guard<std::mutex> lock( _flush_mutex );
+   _store_stats.pending_bytes += sizeof(record_header) + data.size();
+   if( _durability != sync_interval || _store_stats.pending_bytes >= max_pending_bytes )
+   {
+      _write_requested = true;
+      _flush_cv.notify_all();
+   }
 }
 
 void block_database::store( const block_id_type& _id, const signed_block& b )
@@ -79,34 +842,38 @@ void block_database::store( const block_id_type& _id, const signed_block& b )
       id = b.id();
       elog( "id argument of block_database::store() was not initialized for block ${id}", ("id", id) );
    }
+   const auto start = fc::time_point::now();
    auto num = block_header::num_from_id(id);
-   _block_num_to_pos.seekp( sizeof( index_entry ) * num );
-   index_entry e;
-   _blocks.seekp( 0, _blocks.end );
-   auto vec = fc::raw::pack( b );
-   e.block_pos  = _blocks.tellp();
-   e.block_size = vec.size();
-   e.block_id   = id;
-   _blocks.write( vec.data(), vec.size() );
-   _block_num_to_pos.write( (char*)&e, sizeof(e) );
+   auto vec = std::make_shared<vector<char>>( fc::raw::pack( b ) );
+   append( num, id, *vec );
+   // the newest blocks are the ones peers and clients ask for next
+   _cache.insert( num, id, std::move(vec), std::make_shared<signed_block>( b ) );
+   if( _durability == sync_every_block )
+      sync();
+
+   const uint64_t elapsed = (fc::time_point::now() - start).count();
+   std::lock_guard<std::mutex> lock( _flush_mutex );
+   ++_store_stats.blocks;
+   _store_stats.store_time_us += elapsed;
+   _store_stats.last_store_time_us = elapsed;
+   _store_stats.max_store_time_us = std::max( _store_stats.max_store_time_us, elapsed );
 }
 
 void block_database::remove( const block_id_type& id )
 { try {
+   const uint32_t num = block_header::num_from_id(id);
    index_entry e;
-   auto index_pos = sizeof(e)*block_header::num_from_id(id);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   auto seg = read_entry( num, e );
+   if( !seg )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block ${id} not contained in block database", ("id", id));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
    if( e.block_id == id )
    {
+      std::lock_guard<std::mutex> lock( seg->mutex );
+      std::lock_guard<std::mutex> write_lock( _write_mutex );
       e.block_size = 0;
-      _block_num_to_pos.seekp( sizeof(e)*block_header::num_from_id(id) );
-      _block_num_to_pos.write( (char*)&e, sizeof(e) );
+      write_entry( *seg, num, e );
+      _cache.erase( num );
    }
 } FC_CAPTURE_AND_RETHROW( (id) ) }
 
@@ -116,12 +883,8 @@ bool block_database::contains( const block_id_type& id )const
       return false;
 
    index_entry e;
-   auto index_pos = sizeof(e)*block_header::num_from_id(id);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   if( !read_entry( block_header::num_from_id(id), e ) )
       return false;
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
 
    return e.block_id == id && e.block_size > 0;
 }
@@ -130,40 +893,49 @@ block_id_type block_database::fetch_block_id( uint32_t block_num )const
 {
    assert( block_num != 0 );
    index_entry e;
-   auto index_pos = sizeof(e)*block_num;
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= int64_t(index_pos) )
+   if( !read_entry( block_num, e ) )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block number ${block_num} not contained in block database", ("block_num", block_num));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
    FC_ASSERT( e.block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
    return e.block_id;
 }
 
+vector<char> block_database::read_packed( uint32_t block_num, const block_id_type& id )const
+{
+   auto seg = find_segment( block_num );
+   FC_ASSERT( seg, "Block ${num} was pruned", ("num",block_num) );
+   std::lock_guard<std::mutex> lock( seg->mutex );
+   // the entry is read again under the segment lock, compaction may have moved the block since
+   const index_entry e = seg->entry( block_num );
+   FC_ASSERT( e.block_id == id && e.block_size > 0, "Block ${num} was replaced while it was read", ("num",block_num) );
+   return seg->read( e );
+}
+
+optional<signed_block> block_database::read_block( uint32_t block_num, const index_entry& e )const
+{
+   if( e.block_size == 0 )
+      return optional<signed_block>();
+   if( auto cached = _cache.fetch_block( block_num, e.block_id ) )
+      return *cached;
+
+   auto packed = std::make_shared<vector<char>>( read_packed( block_num, e.block_id ) );
+   auto result = std::make_shared<signed_block>( fc::raw::unpack<signed_block>( *packed ) );
+   FC_ASSERT( result->id() == e.block_id );
+   _cache.insert( block_num, e.block_id, packed, result );
+   return *result;
+}
+
 optional<signed_block> block_database::fetch_optional( const block_id_type& id )const
 {
    try
    {
       index_entry e;
-      auto index_pos = sizeof(e)*block_header::num_from_id(id);
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
+      if( !read_entry( block_header::num_from_id(id), e ) )
          return {};
 
-      _block_num_to_pos.seekg( index_pos );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
       if( e.block_id != id ) return optional<signed_block>();
 
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      if (e.block_size)
-         _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      return read_block( block_header::num_from_id(id), e );
    }
    catch (const fc::exception&)
    {
@@ -174,25 +946,39 @@ optional<signed_block> block_database::fetch_optional( const block_id_type& id )
    return optional<signed_block>();
 }
 
+optional<vector<char>> block_database::fetch_packed( const block_id_type& id )const
+{
+   try
+   {
+      index_entry e;
+      const uint32_t num = block_header::num_from_id(id);
+      if( !read_entry( num, e ) || e.block_id != id || e.block_size == 0 )
+         return optional<vector<char>>();
+
+      if( auto cached = _cache.fetch_packed( num, id ) )
+         return *cached;
+      auto packed = std::make_shared<vector<char>>( read_packed( num, id ) );
+      _cache.insert( num, id, packed );
+      return *packed;
+   }
+   catch (const fc::exception&)
+   {
+   }
+   catch (const std::exception&)
+   {
+   }
+   return optional<vector<char>>();
+}
+
 optional<signed_block> block_database::fetch_by_number( uint32_t block_num )const
 {
    try
    {
       index_entry e;
-      auto index_pos = sizeof(e)*block_num;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
+      if( !read_entry( block_num, e ) )
          return {};
 
-      _block_num_to_pos.seekg( index_pos, _block_num_to_pos.beg );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      return read_block( block_num, e );
    }
    catch (const fc::exception&)
    {
@@ -203,34 +989,29 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
    return optional<signed_block>();
 }
 
+uint32_t block_database::last_num()const
+{
+   auto table = std::atomic_load( &_segments );
+   if( !table || table->segments.empty() )
+      return 0;
+   const uint64_t first = uint64_t(table->first) * _blocks_per_segment;
+   index_entry e;
+   for( uint64_t num = _index_size.load( std::memory_order_acquire ); num > first; --num )
+      if( read_entry( num - 1, e ) && e.block_size > 0 )
+         return num - 1;
+   return 0;
+}
+
 optional<signed_block> block_database::last()const
 {
    try
    {
       index_entry e;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-
-      if( _block_num_to_pos.tellp() < sizeof(index_entry) )
-         return optional<signed_block>();
-
-      _block_num_to_pos.seekg( -sizeof(index_entry), _block_num_to_pos.end );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      uint64_t pos = _block_num_to_pos.tellg();
-      while( e.block_size == 0 && pos > 0 )
-      {
-         pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      }
-
-      if( e.block_size == 0 )
+      const uint32_t num = last_num();
+      if( !read_entry( num, e ) || e.block_size == 0 )
          return optional<signed_block>();
 
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      return result;
+      return read_block( num, e );
    }
    catch (const fc::exception&)
    {
@@ -243,37 +1024,213 @@ optional<signed_block> block_database::last()const
 
 optional<block_id_type> block_database::last_id()const
 {
-   try
+   index_entry e;
+   if( !read_entry( last_num(), e ) || e.block_size == 0 )
+      return optional<block_id_type>();
+
+   return e.block_id;
+}
+
+void block_database::prune( uint32_t block_num )
+{
+   auto table = std::atomic_load( &_segments );
+   if( !table || block_num / _blocks_per_segment <= table->first )
+      return;
+
+   const uint32_t keep = std::min( block_num, last_num() ) / _blocks_per_segment;
+   std::vector< std::shared_ptr<block_segment> > dropped;
    {
-      index_entry e;
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
+      std::lock_guard<std::mutex> lock( _write_mutex );
+      table = std::atomic_load( &_segments );
+      if( keep <= table->first )
+         return;
+      const auto split = table->segments.begin() + std::min<size_t>( keep - table->first, table->segments.size() );
+      for( auto itr = table->segments.begin(); itr != split; ++itr )
+         if( *itr )
+         {
+            (*itr)->dropped = true;
+            dropped.push_back( *itr );
+         }
+      auto next = std::make_shared<segment_table>();
+      next->first = keep;
+      next->segments.assign( split, table->segments.end() );
+      std::atomic_store( &_segments, std::shared_ptr<const segment_table>( next ) );
+   }
+   ilog( "Pruned blocks below ${n}", ("n",first_block_num()) );
+   for( auto& seg : dropped )
+      schedule( std::move(seg) );
+}
 
-      if( _block_num_to_pos.tellp() < sizeof(index_entry) )
-         return optional<block_id_type>();
+uint32_t block_database::first_block_num()const
+{
+   auto table = std::atomic_load( &_segments );
+   if( !table )
+      return 1;
+   return std::max<uint32_t>( table->first * _blocks_per_segment, 1 );
+}
 
-      _block_num_to_pos.seekg( -sizeof(index_entry), _block_num_to_pos.end );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      uint64_t pos = _block_num_to_pos.tellg();
-      while( e.block_size == 0 && pos > 0 )
-      {
-         pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
-      }
+void block_database::schedule( std::shared_ptr<block_segment> seg )
+{
+   {
+      std::lock_guard<std::mutex> lock( _tasks_mutex );
+      _tasks.push_back( std::move(seg) );
+   }
+   _tasks_cv.notify_one();
+}
 
+void block_database::run_background_tasks()
+{
+   std::unique_lock<std::mutex> lock( _tasks_mutex );
+   while( true )
+   {
+      _tasks_cv.wait( lock, [this]() { return _stop_tasks || !_tasks.empty(); } );
+      // queued work is finished before the thread exits on close()
+      if( _tasks.empty() )
+         return;
+      auto seg = std::move( _tasks.front() );
+      _tasks.pop_front();
+      lock.unlock();
+      // releasing the last reference to a pruned segment deletes its files
+      if( !seg->dropped )
+         compact( *seg );
+      seg.reset();
+      lock.lock();
+   }
+}
+
+void block_database::compact( block_segment& seg )
+{ try {
+   // the data below file_size is only rewritten here, so it is read without the lock while readers and writers
+   // use the segment, and the result is only swapped in if the entries did not change in the meantime
+   std::vector<index_entry> original;
+   std::vector<frame_entry> old_frames;
+   uint64_t file_size = 0;
+   bool compress = false;
+   {
+      std::lock_guard<std::mutex> lock( seg.mutex );
+      seg.write_pending();
+      original.assign( seg.entries, seg.entries + seg.size );
+      old_frames = seg.frames;
+      file_size = seg.file_size;
+      compress = _compress_segments && seg.has_raw_data();
+   }
+
+   // a frame is kept as a whole as long as one of its blocks is
+   uint64_t live = 0;
+   std::vector<bool> live_frames( old_frames.size() );
+   for( const auto& e : original )
+   {
       if( e.block_size == 0 )
-         return optional<block_id_type>();
+         continue;
+      if( e.block_pos & framed_flag )
+         live_frames[ frame_of( e ) ] = true;
+      else
+         live += sizeof(record_header) + e.block_size;
+   }
+   for( size_t i = 0; i < live_frames.size(); ++i )
+      if( live_frames[i] )
+         live += old_frames[i].compressed_size;
+   // an empty segment has nothing to rewrite, and a few blocks of abandoned forks are not worth rewriting it for
+   if( file_size == 0 || ( !compress && ( live == file_size || file_size - live < file_size / 4 ) ) )
+      return;
+
+   const fc::path data_tmp( seg.blocks_path.generic_string() + ".compact" );
+   const fc::path journal( seg.index_path.generic_string() + ".compact" );
+   const fc::path journal_tmp( journal.generic_string() + ".tmp" );
+   std::vector<index_entry> entries = original;
+   std::vector<frame_entry> frames;
+   uint64_t pos = 0;
+   {
+      std::ifstream in( seg.blocks_path.generic_string().c_str(), std::ifstream::binary );
+      in.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+      uint32_t cached_frame = uint32_t(-1);
+      vector<char> cached_frame_data;
 
-      return e.block_id;
+      std::ofstream out( data_tmp.generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
+      out.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+      vector<char> frame;
+      auto write_frame = [&]()
+      {
+         if( frame.empty() )
+            return;
+         const vector<char> packed = compress_frame( frame );
+         frame_entry f;
+         f.pos = pos;
+         f.compressed_size = packed.size();
+         f.raw_size = frame.size();
+         out.write( packed.data(), packed.size() );
+         pos += packed.size();
+         frames.push_back( f );
+         frame.clear();
+      };
+      for( auto& e : entries )
+      {
+         if( e.block_size == 0 )
+            continue;
+         const vector<char> data = read_stored( in, e, old_frames, cached_frame, cached_frame_data, seg.blocks_path );
+         if( compress )
+         {
+            e.block_pos = framed_flag | (uint64_t( frames.size() ) << 32) | frame.size();
+            frame.insert( frame.end(), data.begin(), data.end() );
+            if( frame.size() >= frame_target_size )
+               write_frame();
+         }
+         else
+         {
+            record_header h;
+            h.size     = data.size();
+            h.checksum = record_checksum( e.block_id, data.data(), data.size() );
+            out.write( (const char*)&h, sizeof(h) );
+            out.write( data.data(), data.size() );
+            e.block_pos = pos;
+            pos += sizeof(h) + data.size();
+         }
+      }
+      write_frame();
+      out.flush();
    }
-   catch (const fc::exception&)
+   sync_file( data_tmp );
    {
+      std::ofstream out( journal_tmp.generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
+      out.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+      out.write( (const char*)entries.data(), entries.size() * sizeof(index_entry) );
+      if( !frames.empty() )
+         out.write( (const char*)frames.data(), frames.size() * sizeof(frame_entry) );
+      out.flush();
    }
-   catch (const std::exception&)
+   sync_file( journal_tmp );
+
+   std::lock_guard<std::mutex> lock( seg.mutex );
+   if( seg.dropped || seg.file_size != file_size || !seg.pending.empty()
+       || !std::equal( original.begin(), original.end(), seg.entries,
+                       []( const index_entry& a, const index_entry& b ) { return std::memcmp( &a, &b, sizeof(a) ) == 0; } ) )
    {
+      // a block was stored in or removed from the segment while it was rewritten, the rewrite is stale
+      fc::remove( journal_tmp );
+      fc::remove( data_tmp );
+      ilog( "Abandoned the compaction of ${f} which changed while it was rewritten", ("f",seg.blocks_path) );
+      return;
    }
-   return optional<block_id_type>();
-}
+   // from here on recover_compaction() finishes the job if we crash
+   fc::rename( journal_tmp, journal );
 
+   seg.blocks.close();
+   fc::rename( data_tmp, seg.blocks_path );
+   seg.blocks.open( seg.blocks_path.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+   seg.file_size = pos;
+   seg.frames = std::move( frames );
+   seg.save_frames();
+   {
+      std::lock_guard<std::mutex> write_lock( _write_mutex );
+      for( uint32_t i = 0; i < seg.size; ++i )
+         if( seg.entries[i].block_pos != entries[i].block_pos )
+            write_entry( seg, seg.number * seg.size + i, entries[i] );
+   }
+   seg.index_region->flush();
+   sync_file( seg.index_path );
+   fc::remove( journal );
+   ilog( "${what} block segment ${f} from ${a} to ${b} bytes",
+         ("what", compress ? "Compressed" : "Compacted")("f",seg.blocks_path)("a",file_size)("b",pos) );
+} FC_CAPTURE_AND_LOG( (seg.blocks_path) ) }
 
 } }
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <graphene/chain/block_prefetcher.hpp>
+
+namespace graphene { namespace chain {
+
+block_prefetcher::block_prefetcher( const block_database& blocks, uint32_t first, uint32_t last, uint32_t threads, uint32_t window )
+:_blocks(blocks),_last(last),_slots(std::max<uint32_t>( window, 1 )),_next_fetch(first),_next_out(first)
+{
+   for( uint32_t i = 0; i < std::max<uint32_t>( threads, 1 ); ++i )
+      _workers.emplace_back( [this]() { run(); } );
+}
+
+block_prefetcher::~block_prefetcher()
+{
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _stop = true;
+   }
+   _space_cv.notify_all();
+   for( auto& t : _workers )
+      t.join();
+}
+
+void block_prefetcher::run()
+{
+   std::unique_lock<std::mutex> lock( _mutex );
+   while( true )
+   {
+      _space_cv.wait( lock, [this]() {
+         return _stop || _next_fetch > _last || _next_fetch - _next_out < _slots.size();
+      });
+      if( _stop || _next_fetch > _last )
+         return;
+      const uint32_t num = _next_fetch++;
+      lock.unlock();
+      // fetch_by_number() reports any failure as a missing block
+      optional<signed_block> block = _blocks.fetch_by_number( num );
+      lock.lock();
+      slot& s = _slots[num % _slots.size()];
+      s.block_num = num;
+      s.block = std::move( block );
+      s.ready = true;
+      _ready_cv.notify_all();
+   }
+}
+
+optional<signed_block> block_prefetcher::next()
+{
+   optional<signed_block> result;
+   {
+      std::unique_lock<std::mutex> lock( _mutex );
+      if( _next_out > _last )
+         return result;
+      slot& s = _slots[_next_out % _slots.size()];
+      if( !s.ready || s.block_num != _next_out )
+      {
+         const auto start = fc::time_point::now();
+         _ready_cv.wait( lock, [&]() { return s.ready && s.block_num == _next_out; } );
+         _wait_time_us += (fc::time_point::now() - start).count();
+      }
+      result = std::move( s.block );
+      s.block.reset();
+      s.ready = false;
+      ++_next_out;
+   }
+   _space_cv.notify_all();
+   return result;
+}
+
+} }
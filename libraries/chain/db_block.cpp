@@ -32,6 +32,8 @@
 #include <graphene/chain/protocol/fee_schedule.hpp>
 #include <graphene/chain/exceptions.hpp>
 
+#include <algorithm>
+
 namespace graphene { namespace chain {
 
 bool database::is_known_block( const block_id_type& id )const
@@ -62,6 +64,14 @@ optional<signed_block> database::fetch_block_by_id( const block_id_type& id )con
    return b->data;
 }
 
+optional<vector<char>> database::fetch_packed_block_by_id( const block_id_type& id )const
+{
+   auto b = _fork_db.fetch_block( id );
+   if( !b )
+      return _block_id_to_block.fetch_packed(id);
+   return fc::raw::pack( b->data );
+}
+
 optional<signed_block> database::fetch_block_by_number( uint32_t num )const
 {
    auto results = _fork_db.fetch_block_by_number(num);
@@ -80,6 +90,21 @@ const signed_transaction& database::get_recent_transaction(const transaction_id_
    return itr->trx;
 }
 
+optional<transaction_location> database::get_transaction_location( const transaction_id_type& trx_id )const
+{
+   // the history only keeps a prefix of the id and locations on abandoned forks, the block has the final word
+   for( const auto& loc : _trx_history.candidates( trx_id ) )
+   {
+      if( loc.block_num > head_block_num() )
+         continue;
+      auto block = fetch_block_by_number( loc.block_num );
+      if( block.valid() && loc.trx_in_block < block->transactions.size()
+          && block->transactions[loc.trx_in_block].id() == trx_id )
+         return loc;
+   }
+   return optional<transaction_location>();
+}
+
 std::vector<block_id_type> database::get_block_ids_on_fork(block_id_type head_of_fork) const
 {
   pair<fork_database::branch_type, fork_database::branch_type> branches = _fork_db.fetch_branch_from(head_block_id(), head_of_fork);
@@ -114,6 +139,24 @@ bool database::push_block(const signed_block& new_block, uint32_t skip)
       [&]()
       {
          result = _push_block(new_block);
+         if( _prune_keep_blocks != 0 || _prune_irreversible_margin.valid() )
+            prune_blocks();
+         if( _block_id_to_block.durability() == block_database::sync_irreversible )
+         {
+            const uint32_t lib = get_dynamic_global_properties().last_irreversible_block_num;
+            if( lib != _last_synced_irreversible_block )
+            {
+               _block_id_to_block.request_sync();
+               _last_synced_irreversible_block = lib;
+            }
+         }
+         // pending transactions are not applied here, so this is the committed head block state
+         if( journal_enabled() )
+         {
+            commit_journal();
+            if( _checkpoint_interval != 0 && head_block_num() % _checkpoint_interval == 0 )
+               checkpoint();
+         }
       });
    });
    return result;
@@ -122,12 +165,14 @@ bool database::push_block(const signed_block& new_block, uint32_t skip)
 bool database::_push_block(const signed_block& new_block)
 { try {
    uint32_t skip = get_node_properties().skip_flags;
+   // hashed once here and handed to the fork database, the block database and apply_block()
+   const block_id_type new_block_id = new_block.id();
    if( !(skip&skip_fork_db) )
    {
       /// TODO: if the block is greater than the head block and before the next maitenance interval
       // verify that the block signer is in the current set of active witnesses.
 
-      shared_ptr<fork_item> new_head = _fork_db.push_block(new_block);
+      shared_ptr<fork_item> new_head = _fork_db.push_block(new_block, new_block_id);
       //If the head block from the longest chain does not build off of the current head, we need to switch forks.
       if( new_head->data.previous != head_block_id() )
       {
@@ -135,8 +180,8 @@ bool database::_push_block(const signed_block& new_block)
          //Only switch forks if new_head is actually higher than head
          if( new_head->data.block_num() > head_block_num() )
          {
-            wlog( "Switching to fork: ${id}", ("id",new_head->data.id()) );
-            auto branches = _fork_db.fetch_branch_from(new_head->data.id(), head_block_id());
+            wlog( "Switching to fork: ${id}", ("id",new_head->id) );
+            auto branches = _fork_db.fetch_branch_from(new_head->id, head_block_id());
 
             // pop blocks until we hit the forked block
             while( head_block_id() != branches.second.back()->data.previous )
@@ -145,11 +190,11 @@ bool database::_push_block(const signed_block& new_block)
             // push all blocks on the new fork
             for( auto ritr = branches.first.rbegin(); ritr != branches.first.rend(); ++ritr )
             {
-                ilog( "pushing blocks from fork ${n} ${id}", ("n",(*ritr)->data.block_num())("id",(*ritr)->data.id()) );
+                ilog( "pushing blocks from fork ${n} ${id}", ("n",(*ritr)->num)("id",(*ritr)->id) );
                 optional<fc::exception> except;
                 try {
                    undo_database::session session = _undo_db.start_undo_session();
-                   apply_block( (*ritr)->data, skip );
+                   apply_block( (*ritr)->data, skip, (*ritr)->id );
                    _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
                    session.commit();
                 }
@@ -160,7 +205,7 @@ bool database::_push_block(const signed_block& new_block)
                    // remove the rest of branches.first from the fork_db, those blocks are invalid
                    while( ritr != branches.first.rend() )
                    {
-                      _fork_db.remove( (*ritr)->data.id() );
+                      _fork_db.remove( (*ritr)->id );
                       ++ritr;
                    }
                    _fork_db.set_head( branches.second.front() );
@@ -173,8 +218,8 @@ bool database::_push_block(const signed_block& new_block)
                    for( auto ritr = branches.second.rbegin(); ritr != branches.second.rend(); ++ritr )
                    {
                       auto session = _undo_db.start_undo_session();
-                      apply_block( (*ritr)->data, skip );
-                      _block_id_to_block.store( new_block.id(), (*ritr)->data );
+                      apply_block( (*ritr)->data, skip, (*ritr)->id );
+                      _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
                       session.commit();
                    }
                    throw *except;
@@ -188,18 +233,50 @@ bool database::_push_block(const signed_block& new_block)
 
    try {
       auto session = _undo_db.start_undo_session();
-      apply_block(new_block, skip);
-      _block_id_to_block.store(new_block.id(), new_block);
+      apply_block(new_block, skip, new_block_id);
+      _block_id_to_block.store(new_block_id, new_block);
       session.commit();
    } catch ( const fc::exception& e ) {
       elog("Failed to push new block:\n${e}", ("e", e.to_detail_string()));
-      _fork_db.remove(new_block.id());
+      _fork_db.remove(new_block_id);
       throw;
    }
 
    return false;
 } FC_CAPTURE_AND_RETHROW( (new_block) ) }
 
+void database::index_transaction_history()
+{
+   const uint32_t head = head_block_num();
+   uint32_t num = std::max( _trx_history.last_block() + 1, _block_id_to_block.first_block_num() );
+   if( num > head )
+      return;
+   ilog( "Adding the transactions of blocks ${a} to ${b} to the transaction history", ("a",num)("b",head) );
+   for( ; num <= head; ++num )
+   {
+      if( num % 100000 == 0 )
+         ilog( "   ${n} of ${h}", ("n",num)("h",head) );
+      auto block = _block_id_to_block.fetch_by_number( num );
+      FC_ASSERT( block.valid(), "Block ${n} is missing from the block database", ("n",num) );
+      for( uint32_t i = 0; i < block->transactions.size(); ++i )
+         _trx_history.add( block->transactions[i].id(), num, i );
+      _trx_history.set_last_block( num );
+   }
+}
+
+void database::prune_blocks()
+{
+   const uint32_t head = head_block_num();
+   const uint32_t lib  = get_dynamic_global_properties().last_irreversible_block_num;
+   uint32_t keep_from = std::numeric_limits<uint32_t>::max();
+   if( _prune_keep_blocks != 0 )
+      keep_from = head > _prune_keep_blocks ? head - _prune_keep_blocks + 1 : 1;
+   if( _prune_irreversible_margin.valid() )
+      keep_from = std::min( keep_from, lib > *_prune_irreversible_margin ? lib - *_prune_irreversible_margin : 1 );
+   // the block database only drops whole segments, this is a no-op until one falls below the cutoff
+   _block_id_to_block.prune( std::min( keep_from, lib ) );
+}
+
 /**
  * Attempts to push the transaction into the pending queue
  *
@@ -457,14 +534,15 @@ const vector<optional< operation_history_object > >& database::get_applied_opera
 
 //////////////////// private methods ////////////////////
 
-void database::apply_block( const signed_block& next_block, uint32_t skip )
+void database::apply_block( const signed_block& next_block, uint32_t skip, const block_id_type& known_id )
 {
+   const block_id_type next_block_id = known_id != block_id_type() ? known_id : next_block.id();
    auto block_num = next_block.block_num();
    if( _checkpoints.size() && _checkpoints.rbegin()->second != block_id_type() )
    {
       auto itr = _checkpoints.find( block_num );
       if( itr != _checkpoints.end() )
-         FC_ASSERT( next_block.id() == itr->second, "Block did not match checkpoint", ("checkpoint",*itr)("block_id",next_block.id()) );
+         FC_ASSERT( next_block_id == itr->second, "Block did not match checkpoint", ("checkpoint",*itr)("block_id",next_block_id) );
 
       if( _checkpoints.rbegin()->first >= block_num )
          skip = ~0;// WE CAN SKIP ALMOST EVERYTHING
@@ -472,18 +550,31 @@ void database::apply_block( const signed_block& next_block, uint32_t skip )
 
    detail::with_skip_flags( *this, skip, [&]()
    {
-      _apply_block( next_block );
+      _apply_block( next_block, next_block_id );
    } );
    return;
 }
 
-void database::_apply_block( const signed_block& next_block )
+void database::_apply_block( const signed_block& next_block, const block_id_type& next_block_id )
 { try {
    uint32_t next_block_num = next_block.block_num();
    uint32_t skip = get_node_properties().skip_flags;
    _applied_ops.clear();
 
-   FC_ASSERT( (skip & skip_merkle_check) || next_block.transaction_merkle_root == next_block.calculate_merkle_root(), "", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",next_block.calculate_merkle_root())("next_block",next_block)("id",next_block.id()) );
+   // the signatures of the transactions in a block are not checked, the block is signed by its witness
+   const uint32_t trx_skip = skip | skip_transaction_signatures;
+   // the checks which do not depend on the state are done for every transaction at once
+   _applied_trxs = precompute_transactions( next_block, trx_skip );
+
+   if( !(skip & skip_merkle_check) )
+   {
+      vector<digest_type> merkle_digests;
+      merkle_digests.reserve( _applied_trxs.size() );
+      for( const auto& pre : _applied_trxs )
+         merkle_digests.push_back( pre.merkle_digest );
+      const checksum_type merkle_root = signed_block::calculate_merkle_root( std::move(merkle_digests) );
+      FC_ASSERT( next_block.transaction_merkle_root == merkle_root, "", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",merkle_root)("next_block",next_block)("id",next_block_id) );
+   }
 
    const witness_object& signing_witness = validate_block_header(skip, next_block);
    const auto& global_props = get_global_properties();
@@ -491,6 +582,14 @@ void database::_apply_block( const signed_block& next_block )
    bool maint_needed = (dynamic_global_props.next_maintenance_time <= next_block.timestamp);
 
    _current_block_num    = next_block_num;
+
+   // with the dupe check every transaction claims the id space of transaction_object and the schedule is serial
+   bool verify_schedule = _speculative_verification && ( skip & skip_transaction_dupe_check )
+                          && next_block.transactions.size() > 1;
+   optional<fc::uint128> speculative_digest;
+   if( verify_schedule )
+      speculative_digest = apply_speculative_schedule( next_block, trx_skip );
+
    _current_trx_in_block = 0;
 
    for( const auto& trx : next_block.transactions )
@@ -501,11 +600,22 @@ void database::_apply_block( const signed_block& next_block )
        * for transactions when validating broadcast transactions or
        * when building a block.
        */
-      apply_transaction( trx, skip | skip_transaction_signatures );
+      const precomputed_transaction& pre = _applied_trxs[_current_trx_in_block];
+      apply_transaction( trx, trx_skip, &pre );
+      if( _trx_history.is_open() )
+         _trx_history.add( pre.id, next_block_num, _current_trx_in_block );
       ++_current_trx_in_block;
    }
+   if( _trx_history.is_open() )
+      _trx_history.set_last_block( next_block_num );
 
-   update_global_dynamic_data(next_block);
+   if( verify_schedule && ( !speculative_digest.valid() || *speculative_digest != state_digest() ) )
+   {
+      ++_speculative_stats.mismatches;
+      elog( "The speculative schedule of block ${n} did not reproduce the serial state", ("n",next_block_num) );
+   }
+
+   update_global_dynamic_data(next_block, next_block_id);
    update_signing_witness(signing_witness, next_block);
    update_last_irreversible_block();
 
@@ -528,13 +638,115 @@ void database::_apply_block( const signed_block& next_block )
    update_maintenance_flag( maint_needed );
    update_witness_schedule();
 
+   if( state_digest_enabled() )
+   {
+      _last_state_digest.block_num = next_block_num;
+      _last_state_digest.digest = state_digest();
+      ilog( "State digest after block ${n}: ${d}", ("n",next_block_num)("d",_last_state_digest.digest) );
+   }
+
    // notify observers that the block has been applied
    applied_block( next_block ); //emit
    _applied_ops.clear();
+   _applied_trxs.clear();
 
    notify_changed_objects();
 } FC_CAPTURE_AND_RETHROW( (next_block.block_num()) )  }
 
+vector<precomputed_transaction> database::precompute_transactions( const signed_block& block, uint32_t skip )
+{
+   vector<precomputed_transaction> result( block.transactions.size() );
+   const chain_id_type& chain_id = get_chain_id();
+   const bool recover_keys = !(skip & (skip_transaction_signatures | skip_authority_check));
+   auto precompute = [&]( size_t i ) {
+      const processed_transaction& trx = block.transactions[i];
+      precomputed_transaction& pre = result[i];
+      pre.digest = trx.digest();
+      pre.id = transaction::id_from_digest( pre.digest );
+      if( !(skip & skip_merkle_check) )
+         pre.merkle_digest = trx.merkle_digest();
+      // a step which fails is left undone, _apply_transaction() repeats it and reports the error in order
+      if( !(skip & skip_validate) )
+      {
+         try
+         {
+            trx.validate();
+            pre.validated = true;
+         }
+         catch( ... ) {}
+      }
+      if( recover_keys )
+      {
+         try
+         {
+            pre.signature_keys = _signature_cache.get_signature_keys( trx, chain_id, pre.digest );
+         }
+         catch( ... ) {}
+      }
+   };
+   // a single transaction has nothing to overlap with, it is not worth waking the workers
+   if( result.size() < 2 )
+   {
+      for( size_t i = 0; i < result.size(); ++i )
+         precompute( i );
+   }
+   else
+      workers().for_each( result.size(), precompute );
+   return result;
+}
+
+optional<fc::uint128> database::apply_speculative_schedule( const signed_block& block, uint32_t skip )
+{
+   const size_t count = block.transactions.size();
+   vector<access_set> sets;
+   sets.reserve( count );
+   for( const auto& trx : block.transactions )
+      sets.push_back( get_access_set( *this, trx, skip ) );
+   const vector<uint32_t> levels = schedule_levels( sets );
+
+   vector<uint32_t> order( count );
+   for( uint32_t i = 0; i < count; ++i )
+      order[i] = i;
+   std::stable_sort( order.begin(), order.end(), [&]( uint32_t a, uint32_t b ) { return levels[a] < levels[b]; } );
+
+   optional<fc::uint128> result;
+   vector<int64_t> elapsed_us( count, 0 );
+   {
+      // forced on during replays, where the undo database is disabled
+      auto session = _undo_db.start_undo_session( true );
+      try
+      {
+         for( uint32_t i : order )
+         {
+            _current_trx_in_block = i;
+            const auto start = fc::time_point::now();
+            apply_transaction( block.transactions[i], skip, &_applied_trxs[i] );
+            elapsed_us[i] = ( fc::time_point::now() - start ).count();
+         }
+         result = state_digest();
+      }
+      catch( const fc::exception& e )
+      {
+         wlog( "The speculative schedule of block ${n} failed: ${e}", ("n",block.block_num())("e",e.to_detail_string()) );
+      }
+   }
+   _applied_ops.clear();
+
+   const uint32_t level_count = *std::max_element( levels.begin(), levels.end() ) + 1;
+   vector<int64_t> slowest( level_count, 0 );
+   for( uint32_t i = 0; i < count; ++i )
+   {
+      slowest[levels[i]] = std::max( slowest[levels[i]], elapsed_us[i] );
+      _speculative_stats.serial_us += elapsed_us[i];
+   }
+   for( int64_t us : slowest )
+      _speculative_stats.critical_path_us += us;
+   ++_speculative_stats.blocks;
+   _speculative_stats.transactions += count;
+   _speculative_stats.levels += level_count;
+   return result;
+}
+
 void database::notify_changed_objects()
 { try {
    if( _undo_db.enabled() ) 
@@ -542,38 +754,42 @@ void database::notify_changed_objects()
       const auto& head_undo = _undo_db.head();
       vector<object_id_type> changed_ids;  changed_ids.reserve(head_undo.old_values.size());
       for( const auto& item : head_undo.old_values ) changed_ids.push_back(item.first);
-      for( const auto& item : head_undo.new_ids ) changed_ids.push_back(item);
+      for( const auto& item : head_undo.packed_old_values ) changed_ids.push_back(item.first);
+      for( const auto& item : head_undo.new_ids ) changed_ids.push_back(item.first);
       vector<const object*> removed;
       removed.reserve( head_undo.removed.size() );
       for( const auto& item : head_undo.removed )
       {
          changed_ids.push_back( item.first );
-         removed.emplace_back( item.second.get() );
+         removed.emplace_back( item.second );
       }
       changed_objects(changed_ids);
    }
 } FC_CAPTURE_AND_RETHROW() }
 
-processed_transaction database::apply_transaction(const signed_transaction& trx, uint32_t skip)
+processed_transaction database::apply_transaction(const signed_transaction& trx, uint32_t skip,
+                                                  const precomputed_transaction* pre)
 {
    processed_transaction result;
    detail::with_skip_flags( *this, skip, [&]()
    {
-      result = _apply_transaction(trx);
+      result = _apply_transaction(trx, pre);
    });
    return result;
 }
 
-processed_transaction database::_apply_transaction(const signed_transaction& trx)
+processed_transaction database::_apply_transaction(const signed_transaction& trx,
+                                                   const precomputed_transaction* pre)
 { try {
    uint32_t skip = get_node_properties().skip_flags;
 
-   if( !(skip&skip_validate) )
+   if( !(skip&skip_validate) && !(pre != nullptr && pre->validated) )
       trx.validate();
 
    auto& trx_idx = get_mutable_index_type<transaction_index>();
    const chain_id_type& chain_id = get_chain_id();
-   auto trx_id = trx.id();
+   const digest_type trx_digest = pre != nullptr ? pre->digest : trx.digest();
+   const transaction_id_type trx_id = pre != nullptr ? pre->id : transaction::id_from_digest( trx_digest );
    FC_ASSERT( (skip & skip_transaction_dupe_check) ||
               trx_idx.indices().get<by_trx_id>().find(trx_id) == trx_idx.indices().get<by_trx_id>().end() );
    transaction_evaluation_state eval_state(this);
@@ -584,7 +800,12 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    {
       auto get_active = [&]( account_id_type id ) { return &id(*this).active; };
       auto get_owner  = [&]( account_id_type id ) { return &id(*this).owner;  };
-      trx.verify_authority( chain_id, get_active, get_owner, get_global_properties().parameters.max_authority_depth );
+      const auto max_depth = get_global_properties().parameters.max_authority_depth;
+      if( pre != nullptr && pre->signature_keys.valid() )
+         graphene::chain::verify_authority( trx.operations, *pre->signature_keys, get_active, get_owner, max_depth );
+      else
+         graphene::chain::verify_authority( trx.operations, _signature_cache.get_signature_keys( trx, chain_id, trx_digest ),
+                                            get_active, get_owner, max_depth );
    }
 
    //Skip all manner of expiration and TaPoS checking if we're on block 1; It's impossible that the transaction is
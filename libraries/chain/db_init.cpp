@@ -200,6 +200,9 @@ void database::initialize_indexes()
    add_index< primary_index<simple_index<chain_property_object          > > >();
    add_index< primary_index<simple_index<witness_schedule_object        > > >();
    add_index< primary_index<simple_index<budget_record_object           > > >();
+
+   // indexes added after this point, e.g. by plugins, are not consensus state
+   mark_state_digest_indexes();
 }
 
 void database::init_genesis(const genesis_state_type& genesis_state)
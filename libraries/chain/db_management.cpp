@@ -21,14 +21,18 @@
 
 #include <graphene/chain/database.hpp>
 
+#include <graphene/chain/block_prefetcher.hpp>
 #include <graphene/chain/operation_history_object.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
 
 #include <fc/io/fstream.hpp>
+#include <fc/io/raw.hpp>
 
+#include <algorithm>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <thread>
 
 namespace graphene { namespace chain {
 
@@ -43,11 +47,27 @@ database::~database()
    clear_pending();
 }
 
-void database::reindex(fc::path data_dir, const genesis_state_type& initial_allocation)
+static fc::path replay_checkpoint_path( const fc::path& data_dir )
+{
+   return data_dir / "object_database" / "replay_checkpoint";
+}
+
+bool database::has_replay_checkpoint( const fc::path& data_dir )
+{
+   return fc::exists( replay_checkpoint_path( data_dir ) );
+}
+
+void database::reindex(fc::path data_dir, const genesis_state_type& initial_allocation, bool resume)
 { try {
-   ilog( "reindexing blockchain" );
-   wipe(data_dir, false);
-   open(data_dir, [&initial_allocation]{return initial_allocation;});
+   uint32_t first_block_num = 1;
+   if( resume && resume_replay( data_dir, initial_allocation ) )
+      first_block_num = head_block_num() + 1;
+   else
+   {
+      ilog( "reindexing blockchain" );
+      wipe(data_dir, false);
+      open(data_dir, [&initial_allocation]{return initial_allocation;});
+   }
 
    auto start = fc::time_point::now();
    auto last_block = _block_id_to_block.last();
@@ -58,44 +78,154 @@ void database::reindex(fc::path data_dir, const genesis_state_type& initial_allo
    }
 
    const auto last_block_num = last_block->block_num();
+   FC_ASSERT( _block_id_to_block.first_block_num() <= first_block_num,
+              "Blocks below ${n} were pruned, the chain cannot be replayed without syncing it again",
+              ("n", _block_id_to_block.first_block_num()) );
 
    ilog( "Replaying blocks..." );
    _undo_db.disable();
-   for( uint32_t i = 1; i <= last_block_num; ++i )
+   uint32_t gap = 0;
    {
-      if( i % 2000 == 0 ) std::cerr << "   " << double(i*100)/last_block_num << "%   "<<i << " of " <<last_block_num<<"   \n";
-      fc::optional< signed_block > block = _block_id_to_block.fetch_by_number(i);
-      if( !block.valid() )
+      // reading, unpacking and hashing blocks overlaps with applying them on this thread
+      block_prefetcher blocks( _block_id_to_block, first_block_num, last_block_num, replay_threads() );
+      uint64_t ops = 0;
+      uint64_t report_ops = 0;
+      uint32_t report_block = first_block_num - 1;
+      auto report_time = start;
+      for( uint32_t i = first_block_num; i <= last_block_num; ++i )
       {
-         wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
-         uint32_t dropped_count = 0;
-         while( true )
+         fc::optional< signed_block > block = blocks.next();
+         if( !block.valid() )
+         {
+            gap = i;
+            break;
+         }
+         apply_block(*block, skip_witness_signature |
+                             skip_transaction_signatures |
+                             skip_transaction_dupe_check |
+                             skip_tapos_check |
+                             skip_witness_schedule_check |
+                             skip_authority_check);
+         for( const auto& trx : block->transactions )
+            ops += trx.operations.size();
+         if( _replay_checkpoint_interval != 0 && i % _replay_checkpoint_interval == 0 && i != last_block_num )
+            save_replay_checkpoint( data_dir );
+
+         if( i % 10000 == 0 || i == last_block_num )
          {
-            fc::optional< block_id_type > last_id = _block_id_to_block.last_id();
-            // this can trigger if we attempt to e.g. read a file that has block #2 but no block #1
-            if( !last_id.valid() )
-               break;
-            // we've caught up to the gap
-            if( block_header::num_from_id( *last_id ) <= i )
-               break;
-            _block_id_to_block.remove( *last_id );
-            dropped_count++;
+            const auto now = fc::time_point::now();
+            const double seconds = std::max<int64_t>( (now - report_time).count(), 1 ) / 1000000.0;
+            ilog( "   ${p}%   ${i} of ${n}   ${b} blocks/s   ${o} ops/s",
+                  ("p",uint64_t(i) * 100 / last_block_num)("i",i)("n",last_block_num)
+                  ("b",uint64_t( (i - report_block) / seconds ))("o",uint64_t( (ops - report_ops) / seconds )) );
+            report_time = now;
+            report_block = i;
+            report_ops = ops;
          }
-         wlog( "Dropped ${n} blocks from after the gap", ("n", dropped_count) );
-         break;
       }
-      apply_block(*block, skip_witness_signature |
-                          skip_transaction_signatures |
-                          skip_transaction_dupe_check |
-                          skip_tapos_check |
-                          skip_witness_schedule_check |
-                          skip_authority_check);
+      const double seconds = std::max<int64_t>( (fc::time_point::now() - start).count(), 1 ) / 1000000.0;
+      const uint32_t replayed = (gap ? gap - 1 : last_block_num) - (first_block_num - 1);
+      ilog( "Replayed ${n} blocks with ${o} operations: ${b} blocks/s, ${r} ops/s, ${w} sec waiting for blocks to be read",
+            ("n",replayed)("o",ops)("b",uint64_t( replayed / seconds ))("r",uint64_t( ops / seconds ))
+            ("w",blocks.wait_time_us() / 1000000.0) );
+      if( _speculative_verification )
+      {
+         const auto& stats = _speculative_stats;
+         ilog( "Speculative schedule of ${b} blocks with ${t} transactions in ${l} levels: ${m} mismatches, "
+               "${s} ms serial, ${c} ms on the critical path",
+               ("b",stats.blocks)("t",stats.transactions)("l",stats.levels)("m",stats.mismatches)
+               ("s",stats.serial_us / 1000)("c",stats.critical_path_us / 1000) );
+      }
+   }
+   if( gap != 0 )
+   {
+      wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", gap) );
+      uint32_t dropped_count = 0;
+      while( true )
+      {
+         fc::optional< block_id_type > last_id = _block_id_to_block.last_id();
+         // this can trigger if we attempt to e.g. read a file that has block #2 but no block #1
+         if( !last_id.valid() )
+            break;
+         // we've caught up to the gap
+         if( block_header::num_from_id( *last_id ) <= gap )
+            break;
+         _block_id_to_block.remove( *last_id );
+         dropped_count++;
+      }
+      wlog( "Dropped ${n} blocks from after the gap", ("n", dropped_count) );
    }
    _undo_db.enable();
+   if( journal_enabled() )
+      checkpoint();
+   // the state is complete, an unclean shutdown from here on is no longer an interrupted replay
+   fc::remove( replay_checkpoint_path( data_dir ) );
    auto end = fc::time_point::now();
    ilog( "Done reindexing, elapsed time: ${t} sec", ("t",double((end-start).count())/1000000.0 ) );
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
+void database::save_replay_checkpoint( const fc::path& data_dir )
+{ try {
+   const auto start = fc::time_point::now();
+   const fc::path marker = replay_checkpoint_path( data_dir );
+   // the state on disk is a mix of two checkpoints until object_database::checkpoint() returns
+   fc::remove( marker );
+   object_database::checkpoint();
+   {
+      std::ofstream out( marker.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+      fc::raw::pack( out, std::make_pair( head_block_num(), head_block_id() ) );
+   }
+   ilog( "Saved a replay checkpoint at block ${n} in ${t} sec",
+         ("n",head_block_num())("t",double( (fc::time_point::now() - start).count() ) / 1000000.0) );
+} FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+
+bool database::resume_replay( const fc::path& data_dir, const genesis_state_type& initial_allocation )
+{
+   const fc::path marker = replay_checkpoint_path( data_dir );
+   if( !fc::exists( marker ) )
+      return false;
+   try
+   {
+      std::string data;
+      fc::read_file_contents( marker, data );
+      const auto checkpoint = fc::raw::unpack< std::pair<uint32_t, block_id_type> >( vector<char>( data.begin(), data.end() ) );
+
+      if( _block_id_to_block.is_open() )
+         close();
+      open( data_dir, [&initial_allocation]{ return initial_allocation; } );
+      FC_ASSERT( head_block_num() == checkpoint.first && head_block_id() == checkpoint.second,
+                 "The saved state is at block ${n} instead of the checkpoint", ("n",head_block_num()) );
+      FC_ASSERT( _block_id_to_block.fetch_block_id( checkpoint.first ) == checkpoint.second,
+                 "The block log no longer contains the checkpoint block" );
+      ilog( "Resuming the replay after block ${n}", ("n",checkpoint.first) );
+      return true;
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Unable to resume the replay from its checkpoint, replaying from the start: ${e}", ("e",e.to_detail_string()) );
+   }
+   return false;
+}
+
+uint32_t database::replay_threads()const
+{
+   if( _replay_threads != 0 )
+      return _replay_threads;
+   // one core stays with the chain thread, beyond a few readers the block files are the limit
+   return std::min( std::max( std::thread::hardware_concurrency(), 2u ) - 1, 4u );
+}
+
+worker_pool& database::workers()
+{
+   if( !_workers )
+   {
+      const uint32_t threads = _worker_threads != 0 ? _worker_threads : std::max( std::thread::hardware_concurrency(), 1u );
+      // the chain thread works on the jobs as well
+      _workers.reset( new worker_pool( threads - 1 ) );
+   }
+   return *_workers;
+}
+
 void database::wipe(const fc::path& data_dir, bool include_blocks)
 {
    ilog("Wiping database", ("include_blocks", include_blocks));
@@ -116,20 +246,55 @@ void database::open(
       _block_id_to_block.open(data_dir / "database" / "block_num_to_block");
 
       if( !find(global_property_id_type()) )
+      {
          init_genesis(genesis_loader());
+         if( journal_enabled() )
+            checkpoint();
+      }
+      reset_state_digest();
 
+      // the state of an interrupted replay trails the block log, reindex() continues it
+      const bool replaying = has_replay_checkpoint( data_dir );
       fc::optional<signed_block> last_block = _block_id_to_block.last();
+      if( !replaying && last_block.valid() && head_block_num() > 0 && last_block->block_num() > head_block_num()
+          && _block_id_to_block.fetch_block_id( head_block_num() ) == head_block_id() )
+      {
+         // the state was recovered from the change journal, which may trail the block log by the blocks
+         // stored before the crash interrupted their journal commit
+         ilog( "Applying blocks ${a} to ${b} missing from the recovered state",
+               ("a",head_block_num()+1)("b",last_block->block_num()) );
+         _undo_db.disable();
+         for( uint32_t i = head_block_num() + 1; i <= last_block->block_num(); ++i )
+         {
+            fc::optional< signed_block > block = _block_id_to_block.fetch_by_number(i);
+            FC_ASSERT( block.valid(), "Block ${i} is missing from the block database", ("i",i) );
+            apply_block(*block, skip_witness_signature |
+                                skip_transaction_signatures |
+                                skip_tapos_check |
+                                skip_witness_schedule_check |
+                                skip_authority_check);
+         }
+         _undo_db.enable();
+         commit_journal();
+      }
+
       if( last_block.valid() )
       {
          _fork_db.start_block( *last_block );
          idump((last_block->id())(last_block->block_num()));
          idump((head_block_id())(head_block_num()));
-         if( last_block->id() != head_block_id() )
+         if( !replaying && last_block->id() != head_block_id() )
          {
               FC_ASSERT( head_block_num() == 0, "last block ID does not match current chain state",
                          ("last_block->id", last_block->id())("head_block_num",head_block_num()) );
          }
       }
+
+      if( _trx_history_enabled )
+      {
+         _trx_history.open( data_dir / "database" / "transaction_history" );
+         index_transaction_history();
+      }
    }
    FC_CAPTURE_LOG_AND_RETHROW( (data_dir) )
 }
@@ -139,9 +304,12 @@ void database::close(bool rewind)
    // TODO:  Save pending tx's on close()
    clear_pending();
 
+   // the state of an interrupted replay must stay at its replay checkpoint for reindex() to resume it
+   const bool replaying = has_replay_checkpoint( get_data_dir() );
+
    // pop all of the blocks that we can given our undo history, this should
    // throw when there is no more undo history to pop
-   if( rewind )
+   if( rewind && !replaying )
    {
       try
       {
@@ -172,11 +340,13 @@ void database::close(bool rewind)
    // DB state (issue #336).
    clear_pending();
 
-   object_database::flush();
+   if( !replaying )
+      object_database::checkpoint();
    object_database::close();
 
    if( _block_id_to_block.is_open() )
       _block_id_to_block.close();
+   _trx_history.close();
 
    _fork_db.reset();
 }
@@ -35,7 +35,7 @@
 
 namespace graphene { namespace chain {
 
-void database::update_global_dynamic_data( const signed_block& b )
+void database::update_global_dynamic_data( const signed_block& b, const block_id_type& block_id )
 {
    const dynamic_global_property_object& _dgp =
       dynamic_global_property_id_type(0)(*this);
@@ -72,7 +72,7 @@ void database::update_global_dynamic_data( const signed_block& b )
          dgp.recently_missed_count--;
 
       dgp.head_block_number = b.block_num();
-      dgp.head_block_id = b.id();
+      dgp.head_block_id = block_id;
       dgp.time = b.timestamp;
       dgp.current_witness = b.witness;
       dgp.recent_slots_filled = (
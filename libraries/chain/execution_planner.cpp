@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <graphene/chain/execution_planner.hpp>
+#include <graphene/chain/database.hpp>
+
+#include <graphene/chain/account_object.hpp>
+#include <graphene/chain/market_evaluator.hpp>
+#include <graphene/chain/transaction_object.hpp>
+
+#include <algorithm>
+
+namespace graphene { namespace chain {
+
+namespace {
+
+   template<typename T>
+   bool intersects( const flat_set<T>& a, const flat_set<T>& b )
+   {
+      auto i = a.begin();
+      auto j = b.begin();
+      while( i != a.end() && j != b.end() )
+      {
+         if( *i < *j )
+            ++i;
+         else if( *j < *i )
+            ++j;
+         else
+            return true;
+      }
+      return false;
+   }
+
+   template<typename T>
+   uint16_t id_space()
+   {
+      return uint16_t( T::space_id ) << 8 | T::type_id;
+   }
+
+   struct access_visitor
+   {
+      typedef void result_type;
+
+      const database& db;
+      access_set&     result;
+
+      access_visitor( const database& d, access_set& r ):db(d),result(r) {}
+
+      /** fees in other assets than the core asset are paid from the fee pool of that asset */
+      template<typename Op>
+      void pay_fee( const Op& op )const
+      {
+         result.accounts.insert( op.fee_payer() );
+         result.read_assets.insert( op.fee.asset_id );
+         if( op.fee.asset_id != asset_id_type() )
+            result.assets.insert( op.fee.asset_id );
+      }
+
+      /**
+       *  Orders in the market may be matched against, which pays their owners, and margin calls may be
+       *  triggered.  Both can create balances the owners did not hold before.
+       */
+      void trade( asset_id_type a, asset_id_type b )const
+      {
+         result.markets.insert( std::make_pair( std::min( a, b ), std::max( a, b ) ) );
+         result.assets.insert( a );
+         result.assets.insert( b );
+         result.id_spaces.insert( id_space<account_balance_object>() );
+         result.id_spaces.insert( id_space<limit_order_object>() );
+
+         const auto& limit_idx = db.get_index_type<limit_order_index>().indices().get<by_price>();
+         const auto& call_idx  = db.get_index_type<call_order_index>().indices().get<by_price>();
+         for( const auto& side : { std::make_pair( a, b ), std::make_pair( b, a ) } )
+         {
+            auto limit_end = limit_idx.upper_bound( price::min( side.first, side.second ) );
+            for( auto itr = limit_idx.lower_bound( price::max( side.first, side.second ) ); itr != limit_end; ++itr )
+               result.accounts.insert( itr->seller );
+            auto call_end = call_idx.upper_bound( price::max( side.first, side.second ) );
+            for( auto itr = call_idx.lower_bound( price::min( side.first, side.second ) ); itr != call_end; ++itr )
+               result.accounts.insert( itr->borrower );
+         }
+      }
+
+      template<typename Op>
+      void operator()( const Op& )const
+      {
+         result.global = true;
+      }
+
+      void operator()( const transfer_operation& op )const
+      {
+         pay_fee( op );
+         result.accounts.insert( op.to );
+         result.read_assets.insert( op.amount.asset_id );
+         const auto& balances = db.get_index_type<account_balance_index>().indices().get<by_balance>();
+         if( balances.find( boost::make_tuple( op.to, op.amount.asset_id ) ) == balances.end() )
+            result.id_spaces.insert( id_space<account_balance_object>() );
+      }
+
+      void operator()( const limit_order_create_operation& op )const
+      {
+         pay_fee( op );
+         trade( op.amount_to_sell.asset_id, op.min_to_receive.asset_id );
+      }
+
+      void operator()( const limit_order_cancel_operation& op )const
+      {
+         pay_fee( op );
+         const auto& orders = db.get_index_type<limit_order_index>().indices().get<by_id>();
+         auto itr = orders.find( op.order );
+         // the order may be created earlier in the same block, it could belong to anything
+         if( itr == orders.end() )
+         {
+            result.global = true;
+            return;
+         }
+         result.accounts.insert( itr->seller );
+         result.id_spaces.insert( id_space<account_balance_object>() );
+         trade( itr->sell_price.base.asset_id, itr->sell_price.quote.asset_id );
+      }
+   };
+
+}
+
+bool access_set::conflicts_with( const access_set& other )const
+{
+   return global || other.global
+       || intersects( accounts, other.accounts )
+       || intersects( assets, other.assets )
+       || intersects( assets, other.read_assets )
+       || intersects( read_assets, other.assets )
+       || intersects( markets, other.markets )
+       || intersects( id_spaces, other.id_spaces );
+}
+
+access_set get_access_set( const database& db, const signed_transaction& trx, uint32_t skip )
+{
+   access_set result;
+   // the transaction itself is remembered for the duplicate check, in the order transactions are applied
+   if( !(skip & database::skip_transaction_dupe_check) )
+      result.id_spaces.insert( id_space<transaction_object>() );
+   access_visitor visitor( db, result );
+   for( const auto& op : trx.operations )
+   {
+      op.visit( visitor );
+      if( result.global )
+         break;
+   }
+   return result;
+}
+
+vector<uint32_t> schedule_levels( const vector<access_set>& sets )
+{
+   vector<uint32_t> levels( sets.size(), 0 );
+   for( size_t j = 0; j < sets.size(); ++j )
+      for( size_t i = 0; i < j; ++i )
+         if( levels[i] + 1 > levels[j] && sets[i].conflicts_with( sets[j] ) )
+            levels[j] = levels[i] + 1;
+   return levels;
+}
+
+} }
@@ -51,14 +51,19 @@ void     fork_database::start_block(signed_block b)
  */
 shared_ptr<fork_item>  fork_database::push_block(const signed_block& b)
 {
-   auto item = std::make_shared<fork_item>(b);
+   return push_block( b, b.id() );
+}
+
+shared_ptr<fork_item>  fork_database::push_block(const signed_block& b, const block_id_type& id)
+{
+   auto item = std::make_shared<fork_item>(b, id);
    try {
       _push_block(item);
    }
    catch ( const unlinkable_block_exception& e )
    {
-      wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",b.id())("num",b.block_num()) );
-      wlog( "Head: ${num}, ${id}", ("num",_head->data.block_num())("id",_head->data.id()) );
+      wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",id)("num",item->num) );
+      wlog( "Head: ${num}, ${id}", ("num",_head->num)("id",_head->id) );
       throw;
       _unlinked_index.insert( item );
    }
@@ -21,6 +21,7 @@
 #pragma once
 #include <graphene/chain/protocol/operations.hpp>
 #include <graphene/db/generic_index.hpp>
+#include <graphene/db/simple_index.hpp>
 #include <boost/multi_index/composite_key.hpp>
 
 namespace graphene { namespace chain {
@@ -309,7 +310,7 @@ namespace graphene { namespace chain {
    /**
     * @ingroup object_index
     */
-   typedef generic_index<account_balance_object, account_balance_object_multi_index_type> account_balance_index;
+   typedef generic_index<account_balance_object, account_balance_object_multi_index_type, true> account_balance_index;
 
    struct by_name{};
 
@@ -327,10 +328,15 @@ namespace graphene { namespace chain {
    /**
     * @ingroup object_index
     */
-   typedef generic_index<account_object, account_multi_index_type> account_index;
+   typedef generic_index<account_object, account_multi_index_type, true> account_index;
 
 }}
 
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::account_object, graphene::chain::account_index )
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::account_balance_object, graphene::chain::account_balance_index )
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::account_statistics_object,
+                         graphene::db::simple_index<graphene::chain::account_statistics_object> )
+
 FC_REFLECT_DERIVED( graphene::chain::account_object,
                     (graphene::db::object),
                     (membership_expiration_date)(registrar)(referrer)(lifetime_referrer)
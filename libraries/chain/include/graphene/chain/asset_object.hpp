@@ -23,6 +23,7 @@
 #include <boost/multi_index/composite_key.hpp>
 #include <graphene/db/flat_index.hpp>
 #include <graphene/db/generic_index.hpp>
+#include <graphene/db/simple_index.hpp>
 
 /**
  * @defgroup prediction_market Prediction Market
@@ -233,10 +234,15 @@ namespace graphene { namespace chain {
          ordered_non_unique< tag<by_type>, const_mem_fun<asset_object, bool, &asset_object::is_market_issued> >
       >
    > asset_object_multi_index_type;
-   typedef generic_index<asset_object, asset_object_multi_index_type> asset_index;
+   typedef generic_index<asset_object, asset_object_multi_index_type, true> asset_index;
 
 } } // graphene::chain
 
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::asset_object, graphene::chain::asset_index )
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::asset_bitasset_data_object, graphene::chain::asset_bitasset_data_index )
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::asset_dynamic_data_object,
+                         graphene::db::simple_index<graphene::chain::asset_dynamic_data_object> )
+
 FC_REFLECT_DERIVED( graphene::chain::asset_dynamic_data_object, (graphene::db::object),
                     (current_supply)(confidential_supply)(accumulated_fees)(fee_pool) )
 
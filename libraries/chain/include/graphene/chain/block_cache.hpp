@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+#include <graphene/chain/protocol/block.hpp>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace graphene { namespace chain {
+
+   struct block_cache_stats
+   {
+      uint64_t hits     = 0;
+      uint64_t misses   = 0;
+      uint64_t entries  = 0;
+      uint64_t size     = 0; ///< bytes charged for the cached blocks
+      uint64_t capacity = 0;
+   };
+
+   /**
+    *  @class block_cache
+    *  @brief Bounded LRU cache of recently read blocks keyed by block number
+    *
+    *  Every entry holds the serialized block and, once a caller needed it, the unpacked block as well.  An entry
+    *  is charged the packed size for each form it holds and the least recently used entries are dropped once
+    *  the total exceeds the capacity.  Lookups name the block id which the caller expects at that height, an
+    *  entry for a different block counts as a miss.  All methods may be called from any thread.
+    */
+   class block_cache
+   {
+      public:
+         explicit block_cache( uint64_t capacity );
+
+         /** a capacity of 0 disables the cache */
+         void     set_capacity( uint64_t capacity );
+         uint64_t capacity()const;
+
+         std::shared_ptr<const signed_block> fetch_block( uint32_t block_num, const block_id_type& id );
+         std::shared_ptr<const vector<char>> fetch_packed( uint32_t block_num, const block_id_type& id );
+
+         /** adds the given forms to the entry of block_num, replacing it when it holds another block */
+         void insert( uint32_t block_num, const block_id_type& id,
+                      std::shared_ptr<const vector<char>> packed,
+                      std::shared_ptr<const signed_block> block = std::shared_ptr<const signed_block>() );
+         void erase( uint32_t block_num );
+         void clear();
+
+         block_cache_stats stats()const;
+
+      private:
+         struct entry
+         {
+            uint32_t                            block_num = 0;
+            block_id_type                       id;
+            std::shared_ptr<const vector<char>> packed;
+            std::shared_ptr<const signed_block> block;
+
+            uint64_t size()const { return packed->size() * (block ? 2 : 1); }
+         };
+         typedef std::list<entry> lru_list;
+
+         /** @return the entry of block_num holding id moved to the front, nullptr if there is none */
+         entry* touch( uint32_t block_num, const block_id_type& id );
+         void   erase( std::unordered_map<uint32_t, lru_list::iterator>::iterator itr );
+         void   evict();
+
+         mutable std::mutex                                 _mutex;
+         lru_list                                           _lru;    ///< most recently used first
+         std::unordered_map<uint32_t, lru_list::iterator>   _by_num;
+         block_cache_stats                                  _stats;
+   };
+
+} }
+
+FC_REFLECT( graphene::chain::block_cache_stats, (hits)(misses)(entries)(size)(capacity) )
@@ -20,15 +20,87 @@
  */
 #pragma once
 #include <fstream>
+#include <graphene/chain/block_cache.hpp>
 #include <graphene/chain/protocol/block.hpp>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 namespace graphene { namespace chain {
+   struct block_store_stats
+   {
+      uint64_t blocks             = 0; ///< blocks stored since the database was opened
+      uint64_t store_time_us      = 0; ///< total time spent in store(), including waiting for fsync
+      uint64_t max_store_time_us  = 0;
+      uint64_t last_store_time_us = 0;
+      uint64_t writes             = 0; ///< batches of buffered blocks handed to the operating system
+      uint64_t syncs              = 0;
+      uint64_t sync_time_us       = 0; ///< total time spent in fsync
+      uint64_t max_sync_time_us   = 0;
+      uint64_t pending_bytes      = 0; ///< stored but not yet written to the files
+   };
+
+   struct index_entry;
+   struct block_segment;
+   struct segment_table;
+
+   /**
+    *  Stores blocks in segments of blocks_per_segment consecutive block numbers.  Every segment is a pair of
+    *  files, "blocks-N" which blocks are appended to and "index-N" which holds a fixed size entry per block
+    *  number, where N is the first block number of the segment.
+    *
+    *  The index files are memory mapped, lookups of block ids are array loads which may run on any thread
+    *  concurrently with the writer.  Reads of block data are serialized per segment.  Recently stored and read
+    *  blocks are kept in a block_cache, so repeated reads of the chain tip neither touch the disk nor unpack
+    *  the block again.
+    *
+    *  Whole segments below a given block number can be pruned.  Deleting their files and compacting segments
+    *  which were left with the data of forked out blocks happens on a background thread.  With compression
+    *  enabled that thread also rewrites segments which are out of reach of forks as zlib compressed frames of
+    *  consecutive blocks, reads of such blocks decompress their frame transparently.
+    *
+    *  store() only appends the block to a buffer of its segment, a flusher thread writes the buffers to the files
+    *  and fsyncs them as the durability_mode asks for.  Buffered blocks are served to readers from memory.
+    *
+    *  Blocks are written with their size and a checksum.  open() verifies the newest blocks and cuts the log back to
+    *  the last intact block, which repairs what an unclean shutdown left behind without checking the whole chain.
+    */
    class block_database 
    {
       public:
+         enum durability_mode
+         {
+            os_buffered,       ///< blocks are written as soon as possible, the operating system decides when they reach the disk
+            sync_every_block,  ///< store() returns once the block is on disk, blocks stored meanwhile are synced together
+            sync_interval,     ///< buffered blocks are written and synced every sync interval
+            sync_irreversible  ///< blocks are written as soon as possible and synced when request_sync() is called
+         };
+
+         explicit block_database( uint32_t blocks_per_segment = default_blocks_per_segment );
+         ~block_database();
+
+         /** may be called at any time, the interval only applies to sync_interval */
+         void            set_durability( durability_mode mode, uint32_t sync_interval_ms = 1000 );
+         durability_mode durability()const { return _durability; }
+
+         /** compresses segments as they fall two segments behind the head, existing ones once this is opened */
+         void set_compression( bool enabled ) { _compress_segments = enabled; }
+         bool compression()const { return _compress_segments; }
+
+         /** opens the log in dbdir, a log in the single file format of earlier versions is converted */
          void open( const fc::path& dbdir );
          bool is_open()const;
+         /** hands buffered blocks to the operating system */
          void flush();
+         /** writes buffered blocks and waits until everything stored so far is on disk */
+         void sync();
+         /** makes everything stored so far durable on the flusher thread without waiting for it */
+         void request_sync();
+         /** waits for background work to finish and closes the log */
          void close();
 
          void store( const block_id_type& id, const signed_block& b );
@@ -38,10 +110,91 @@ namespace graphene { namespace chain {
          block_id_type          fetch_block_id( uint32_t block_num )const;
          optional<signed_block> fetch_optional( const block_id_type& id )const;
          optional<signed_block> fetch_by_number( uint32_t block_num )const;
+         /** @return the block exactly as stored by fc::raw::pack, without unpacking it or rehashing its id */
+         optional<vector<char>> fetch_packed( const block_id_type& id )const;
          optional<signed_block> last()const;
          optional<block_id_type> last_id()const;
+
+         /**
+          *  Drops every segment which only holds blocks below block_num, the segment of the last block is always
+          *  kept.  Blocks of dropped segments are no longer found, their files are deleted in the background.
+          */
+         void     prune( uint32_t block_num );
+         /** @return the lowest block number which was not pruned */
+         uint32_t first_block_num()const;
+         uint32_t blocks_per_segment()const { return _blocks_per_segment; }
+
+         /** bytes of blocks kept in memory, 0 disables the cache */
+         void              set_cache_size( uint64_t bytes ) { _cache.set_capacity( bytes ); }
+         block_cache_stats cache_stats()const { return _cache.stats(); }
+         block_store_stats store_stats()const;
+
+         static const uint32_t default_blocks_per_segment = 64 * 1024;
+         static const uint64_t default_cache_size = 32 * 1024 * 1024;
+         /** bytes written in front of every block which is not compressed */
+         static const uint32_t record_header_size = 8;
       private:
-         mutable std::fstream _blocks;
-         mutable std::fstream _block_num_to_pos;
+         std::shared_ptr<block_segment> find_segment( uint32_t block_num )const;
+         /** @return the segment of block_num, which is created if it does not exist yet */
+         std::shared_ptr<block_segment> writable_segment( uint32_t block_num );
+         /** copies the index entry of block_num, @return its segment or nullptr if the entry does not exist */
+         std::shared_ptr<block_segment> read_entry( uint32_t block_num, index_entry& e )const;
+         /** must be called with both the segment mutex and _write_mutex held */
+         void write_entry( block_segment& seg, uint32_t block_num, const index_entry& e );
+         void append( uint32_t block_num, const block_id_type& id, const vector<char>& data );
+         void run_flusher();
+         /** writes the buffers of all segments, then fsyncs the segments changed since the last sync if sync is set */
+         void write_segments( bool sync );
+         /** @return the number of the highest block which was not removed, 0 if there is none */
+         uint32_t last_num()const;
+         optional<signed_block> read_block( uint32_t block_num, const index_entry& e )const;
+         vector<char>           read_packed( uint32_t block_num, const block_id_type& id )const;
+
+         /** drops the blocks from the first missing or damaged one among the newest blocks of table upwards */
+         void recover_tail( const segment_table& table );
+         void import_legacy_log( const fc::path& dbdir );
+         void schedule( std::shared_ptr<block_segment> seg );
+         void run_background_tasks();
+         /** rewrites the blocks file of seg without the data of removed and overwritten blocks */
+         void compact( block_segment& seg );
+
+         fc::path                                           _dir;
+         uint32_t                                           _blocks_per_segment;
+         bool                                               _open = false;
+         /** replaced as a whole when segments are added or pruned, use std::atomic_load and std::atomic_store */
+         std::shared_ptr<const segment_table>               _segments;
+         std::atomic<uint64_t>                              _index_size;
+         /** odd while the writer updates an entry, readers retry when it changed under them */
+         std::atomic<uint64_t>                              _index_seq;
+         /** serializes changes of the index and of the segment table */
+         std::mutex                                         _write_mutex;
+
+         /** segments to compact, or to delete once the last reference to a pruned segment is released */
+         std::deque< std::shared_ptr<block_segment> >       _tasks;
+         std::mutex                                         _tasks_mutex;
+         std::condition_variable                            _tasks_cv;
+         bool                                               _stop_tasks = false;
+         std::thread                                        _background;
+
+         std::atomic<bool>                                  _compress_segments;
+         durability_mode                                    _durability = os_buffered;
+         uint32_t                                           _sync_interval_ms = 1000;
+         std::thread                                        _flusher;
+         mutable std::mutex                                 _flush_mutex;
+         std::condition_variable                            _flush_cv;    ///< wakes the flusher
+         std::condition_variable                            _flushed_cv;  ///< signalled when a sync round completed
+         bool                                               _write_requested = false;
+         bool                                               _sync_requested = false;
+         bool                                               _stop_flusher = false;
+         bool                                               _flush_failed = false;
+         uint64_t                                           _sync_rounds_started = 0;
+         uint64_t                                           _sync_rounds_done = 0;
+         block_store_stats                                  _store_stats;
+
+         mutable block_cache                                _cache;
    };
 } }
+
+FC_REFLECT( graphene::chain::block_store_stats,
+            (blocks)(store_time_us)(max_store_time_us)(last_store_time_us)
+            (writes)(syncs)(sync_time_us)(max_sync_time_us)(pending_bytes) )
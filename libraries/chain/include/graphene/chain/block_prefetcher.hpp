@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+#include <graphene/chain/block_database.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @class block_prefetcher
+    *  @brief Reads and unpacks a range of stored blocks ahead of the thread applying them
+    *
+    *  Worker threads fetch block numbers in order from the block_database, which unpacks them and checks their ids,
+    *  and park the results in a window of slots.  next() hands the blocks out in block number order.  Workers
+    *  never run more than the window ahead of the consumer, so memory use stays bounded however fast the disk is.
+    */
+   class block_prefetcher
+   {
+      public:
+         /** starts threads workers on blocks first to last of blocks, which must stay open until this is destroyed */
+         block_prefetcher( const block_database& blocks, uint32_t first, uint32_t last, uint32_t threads, uint32_t window = 256 );
+         ~block_prefetcher();
+
+         /** @return the next block, waiting for it if necessary, null if it is missing or all blocks were handed out */
+         optional<signed_block> next();
+
+         /** time next() spent waiting for workers, the part of reading and decoding which did not overlap */
+         uint64_t wait_time_us()const { return _wait_time_us; }
+
+      private:
+         struct slot
+         {
+            uint32_t               block_num = 0;
+            bool                   ready     = false;
+            optional<signed_block> block;
+         };
+
+         void run();
+
+         const block_database&      _blocks;
+         const uint32_t             _last;
+         std::vector<slot>          _slots;
+         std::mutex                 _mutex;
+         std::condition_variable    _ready_cv;  ///< signalled when a slot was filled
+         std::condition_variable    _space_cv;  ///< signalled when a slot was emptied
+         uint32_t                   _next_fetch;
+         uint32_t                   _next_out;
+         bool                       _stop = false;
+         uint64_t                   _wait_time_us = 0;
+         std::vector<std::thread>   _workers;
+   };
+
+} }
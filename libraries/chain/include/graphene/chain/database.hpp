@@ -26,6 +26,10 @@
 #include <graphene/chain/asset_object.hpp>
 #include <graphene/chain/fork_database.hpp>
 #include <graphene/chain/block_database.hpp>
+#include <graphene/chain/transaction_history.hpp>
+#include <graphene/chain/worker_pool.hpp>
+#include <graphene/chain/signature_cache.hpp>
+#include <graphene/chain/execution_planner.hpp>
 #include <graphene/chain/genesis_state.hpp>
 
 #include <graphene/db/object_database.hpp>
@@ -45,6 +49,26 @@ namespace graphene { namespace chain {
 
    struct budget_record;
 
+   /** Digest of the consensus state right after a block was applied, see object_database::state_digest() */
+   struct state_digest_record
+   {
+      uint32_t    block_num = 0;
+      fc::uint128 digest;
+   };
+
+   /**
+    *  What the stateless stages before a block is applied learned about one of its transactions, so that neither
+    *  the chain thread nor the observers of applied_block have to hash the transaction again.
+    */
+   struct precomputed_transaction
+   {
+      digest_type                           digest;         ///< transaction::digest()
+      transaction_id_type                   id;             ///< transaction::id(), derived from the digest
+      digest_type                           merkle_digest;  ///< processed_transaction::merkle_digest()
+      bool                                  validated = false; ///< transaction::validate() passed
+      optional< flat_set<public_key_type> > signature_keys; ///< empty if not needed or recovering them failed
+   };
+
    /**
     *   @class database
     *   @brief tracks the blockchain state in an extensible manner
@@ -94,8 +118,14 @@ namespace graphene { namespace chain {
           *
           * This method may be called after or instead of @ref database::open, and will rebuild the object graph by
           * replaying blockchain history. When this method exits successfully, the database will be open.
+          *
+          * @param resume continue from the replay checkpoint left by an interrupted replay if there is a usable one,
+          * otherwise the replay starts from the first block
           */
-         void reindex(fc::path data_dir, const genesis_state_type& initial_allocation = genesis_state_type());
+         void reindex(fc::path data_dir, const genesis_state_type& initial_allocation = genesis_state_type(), bool resume = false);
+
+         /** @return true if the state in data_dir is that of an interrupted replay, which only reindex() can complete */
+         static bool has_replay_checkpoint( const fc::path& data_dir );
 
          /**
           * @brief wipe Delete database from disk, and potentially the raw chain as well.
@@ -106,6 +136,55 @@ namespace graphene { namespace chain {
          void wipe(const fc::path& data_dir, bool include_blocks);
          void close(bool rewind = true);
 
+         /**
+          * @brief Checkpoint the object database every interval blocks while the change journal is enabled,
+          * which bounds the size of the journal that has to be rolled forward after a crash.  0 only
+          * checkpoints on close.
+          */
+         void set_checkpoint_interval( uint32_t interval ) { _checkpoint_interval = interval; }
+
+         /**
+          * @brief Delete old blocks from disk as the chain advances, for nodes which do not serve history
+          * @param keep_blocks if nonzero, keep the last keep_blocks blocks
+          * @param irreversible_margin if set, keep the blocks above the last irreversible block minus this margin
+          *
+          * When both are given the larger range is kept.  Reversible blocks are never pruned, and a node with pruned
+          * blocks can no longer replay the chain.
+          */
+         void set_block_pruning( uint32_t keep_blocks, optional<uint32_t> irreversible_margin = optional<uint32_t>() )
+         {
+            _prune_keep_blocks = keep_blocks;
+            _prune_irreversible_margin = irreversible_margin;
+         }
+
+         /**
+          * @brief Record the block and position of every transaction on disk for get_transaction_location(), must be
+          * set before open().  Blocks which were applied while it was disabled are indexed by open().
+          */
+         void set_transaction_history( bool enabled ) { _trx_history_enabled = enabled; }
+
+         /** Threads which read and unpack blocks ahead of reindex(), 0 picks a number from the available cores */
+         void set_replay_threads( uint32_t threads ) { _replay_threads = threads; }
+         /** Checkpoint the object database every interval blocks of a replay so that it can be resumed, 0 disables this */
+         void set_replay_checkpoint_interval( uint32_t interval ) { _replay_checkpoint_interval = interval; }
+         /**
+          * Threads, counting the chain thread, which run the stateless checks of the transactions in a block in
+          * parallel.  1 runs them on the chain thread alone, 0 uses every core.  Must be set before the first block
+          * is applied.
+          */
+         void set_worker_threads( uint32_t threads ) { _worker_threads = threads; }
+         /**
+          *  Before the transactions of a block are applied, apply them in the order in which a parallel engine
+          *  would commit non-conflicting groups of them (see schedule_levels()), record the state digest and undo
+          *  them again.  The digest after the serial application must match, mismatches are logged and counted.
+          *  This only verifies the schedule and measures what it would gain, the block is still applied serially.
+          *  Only blocks applied with skip_transaction_dupe_check are verified, as during a replay, since the dupe
+          *  check makes every transaction of a live block conflict with every other one.
+          *  Enables the state digest, must be called before open().
+          */
+         void enable_speculative_verification() { _speculative_verification = true; enable_state_digest(); }
+         const speculative_execution_stats& get_speculative_execution_stats()const { return _speculative_stats; }
+
          //////////////////// db_block.cpp ////////////////////
 
          /**
@@ -117,9 +196,32 @@ namespace graphene { namespace chain {
          block_id_type              get_block_id_for_num( uint32_t block_num )const;
          optional<signed_block>     fetch_block_by_id( const block_id_type& id )const;
          optional<signed_block>     fetch_block_by_number( uint32_t num )const;
+         /** @return the serialized block, blocks on disk are returned as stored without being unpacked */
+         optional<vector<char>>     fetch_packed_block_by_id( const block_id_type& id )const;
          const signed_transaction&  get_recent_transaction( const transaction_id_type& trx_id )const;
+         /** @return where the transaction was included, if the transaction history is enabled and its block still stored */
+         optional<transaction_location> get_transaction_location( const transaction_id_type& trx_id )const;
          std::vector<block_id_type> get_block_ids_on_fork(block_id_type head_of_fork) const;
 
+         /** Limits the memory used to cache blocks read from disk, 0 disables the cache */
+         void                       set_block_cache_size( uint64_t bytes ) { _block_id_to_block.set_cache_size( bytes ); }
+         block_cache_stats          get_block_cache_stats()const { return _block_id_to_block.cache_stats(); }
+
+         /**
+          *  Chooses when stored blocks are synced to disk, see block_database::durability_mode.  With
+          *  sync_irreversible a sync is started whenever the last irreversible block advances.
+          */
+         void                       set_block_durability( block_database::durability_mode mode, uint32_t sync_interval_ms = 1000 )
+         {
+            _block_id_to_block.set_durability( mode, sync_interval_ms );
+         }
+         block_store_stats          get_block_store_stats()const { return _block_id_to_block.store_stats(); }
+         /** Limits the number of transactions whose signing keys are remembered, 0 disables the cache */
+         void                       set_signature_cache_size( uint64_t entries ) { _signature_cache.set_capacity( entries ); }
+         signature_cache_stats      get_signature_cache_stats()const { return _signature_cache.stats(); }
+         /** Compress stored blocks once they are far enough behind the head, must be set before open() */
+         void                       set_block_compression( bool enabled ) { _block_id_to_block.set_compression( enabled ); }
+
          /**
           *  Calculate the percent of block production slots that were missed in the
           *  past 128 blocks, not including the current block.
@@ -165,6 +267,8 @@ namespace graphene { namespace chain {
          uint32_t  push_applied_operation( const operation& op );
          void      set_applied_operation_result( uint32_t op_id, const operation_result& r );
          const vector<optional< operation_history_object > >& get_applied_operations()const;
+         /** @return one entry per transaction of the block being applied, valid while applied_block is emitted */
+         const vector<precomputed_transaction>&                get_applied_transactions()const { return _applied_trxs; }
 
          string to_pretty_string( const asset& a )const;
 
@@ -245,6 +349,9 @@ namespace graphene { namespace chain {
          const node_property_object&            get_node_properties()const;
          const fee_schedule&                    current_fee_schedule()const;
 
+         /** @return the state digest recorded after the last applied block, empty unless enabled */
+         const state_digest_record&             get_state_digest()const { return _last_state_digest; }
+
          time_point_sec   head_block_time()const;
          uint32_t         head_block_num()const;
          block_id_type    head_block_id()const;
@@ -409,12 +516,43 @@ namespace graphene { namespace chain {
 
          //////////////////// db_block.cpp ////////////////////
 
-         void                  apply_block( const signed_block& next_block, uint32_t skip = skip_nothing );
-         processed_transaction apply_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
-         void                  _apply_block( const signed_block& next_block );
-         processed_transaction _apply_transaction( const signed_transaction& trx );
+         /** next_block_id is computed from next_block if the caller did not know it */
+         void                  apply_block( const signed_block& next_block, uint32_t skip = skip_nothing,
+                                            const block_id_type& next_block_id = block_id_type() );
+         processed_transaction apply_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing,
+                                                  const precomputed_transaction* pre = nullptr );
+         void                  _apply_block( const signed_block& next_block, const block_id_type& next_block_id );
+         /**
+          *  Runs the checks of the transactions of block which do not depend on the state on the worker pool: hashes
+          *  them and, unless skip excludes it, validates them and recovers the keys which signed them.  Failures are
+          *  not reported here, the chain thread repeats the failed step in order so that the same error surfaces.
+          */
+         vector<precomputed_transaction> precompute_transactions( const signed_block& block, uint32_t skip );
+         /**
+          *  Applies the transactions of block in the order of their schedule_levels() inside an undo session which
+          *  is undone again, see enable_speculative_verification().
+          *  @return the state digest after the last transaction, empty if one of them failed
+          */
+         optional<fc::uint128> apply_speculative_schedule( const signed_block& block, uint32_t skip );
+         /** adds the transactions of the stored blocks above the last one in the transaction history */
+         void                  index_transaction_history();
+         /** drops stored blocks which fell out of the range kept by set_block_pruning() */
+         void                  prune_blocks();
+         /** pre holds the hashes and signing keys of trx if the caller computed them already */
+         processed_transaction _apply_transaction( const signed_transaction& trx,
+                                                   const precomputed_transaction* pre = nullptr );
          operation_result      apply_operation( transaction_evaluation_state& eval_state, const operation& op );
 
+         //////////////////// db_management.cpp ////////////////////
+
+         /** @return the number of block_prefetcher threads used by reindex() */
+         uint32_t              replay_threads()const;
+         /** @return the pool for stateless work on the transactions of a block, started on first use */
+         worker_pool&          workers();
+         void                  save_replay_checkpoint( const fc::path& data_dir );
+         /** opens the state saved by save_replay_checkpoint(), @return false if there is none or it is unusable */
+         bool                  resume_replay( const fc::path& data_dir, const genesis_state_type& initial_allocation );
+
 
          ///Steps involved in applying a new block
          ///@{
@@ -424,7 +562,7 @@ namespace graphene { namespace chain {
          void create_block_summary(const signed_block& next_block);
 
          //////////////////// db_update.cpp ////////////////////
-         void update_global_dynamic_data( const signed_block& b );
+         void update_global_dynamic_data( const signed_block& b, const block_id_type& block_id );
          void update_signing_witness(const witness_object& signing_witness, const signed_block& new_block);
          void update_last_irreversible_block();
          void clear_expired_transactions();
@@ -466,6 +604,7 @@ namespace graphene { namespace chain {
           *  the fork tree relatively simple.
           */
          block_database   _block_id_to_block;
+         transaction_history _trx_history;
 
          /**
           * Contains the set of ops that are in the process of being applied from
@@ -474,6 +613,7 @@ namespace graphene { namespace chain {
           * emited.
           */
          vector<optional<operation_history_object> >  _applied_ops;
+         vector<precomputed_transaction>              _applied_trxs;
 
          uint32_t                          _current_block_num    = 0;
          uint16_t                          _current_trx_in_block = 0;
@@ -487,6 +627,23 @@ namespace graphene { namespace chain {
 
          flat_map<uint32_t,block_id_type>  _checkpoints;
 
+         uint32_t                          _checkpoint_interval = 0;
+
+         uint32_t                          _prune_keep_blocks = 0;
+         uint32_t                          _last_synced_irreversible_block = 0;
+         optional<uint32_t>                _prune_irreversible_margin;
+         bool                              _trx_history_enabled = false;
+         uint32_t                          _replay_threads = 0;
+         uint32_t                          _replay_checkpoint_interval = 0;
+         uint32_t                          _worker_threads = 0;
+         bool                              _speculative_verification = false;
+         speculative_execution_stats       _speculative_stats;
+         std::unique_ptr<worker_pool>      _workers;
+         /** shared by pushed transactions, the rebuilt pending state and the transactions of applied blocks */
+         signature_cache                   _signature_cache{ signature_cache::default_capacity };
+
+         state_digest_record               _last_state_digest;
+
          node_property_object              _node_property_object;
    };
 
@@ -510,3 +667,5 @@ namespace graphene { namespace chain {
    }
 
 } }
+
+FC_REFLECT( graphene::chain::state_digest_record, (block_num)(digest) )
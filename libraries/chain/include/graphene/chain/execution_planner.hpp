@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+#include <graphene/chain/protocol/transaction.hpp>
+
+namespace graphene { namespace chain {
+
+   class database;
+
+   /**
+    *  @brief What applying a transaction may touch
+    *
+    *  Objects are named by what owns them: the balances, statistics and orders of an account, the dynamic data and
+    *  bitasset data of an asset, the orders of a market.  Apart from assets, which every transfer reads, every
+    *  access counts as a write.  Two transactions whose sets do not conflict can be applied in either order with
+    *  the same result.  Operations which are not understood here touch everything.
+    */
+   struct access_set
+   {
+      flat_set<account_id_type>                          accounts;
+      flat_set<asset_id_type>                            assets;      ///< written, e.g. fee pools and market fees
+      flat_set<asset_id_type>                            read_assets; ///< only read, e.g. for the whitelists
+      flat_set< std::pair<asset_id_type,asset_id_type> > markets;   ///< the lower asset id first
+      flat_set<uint16_t>                                 id_spaces; ///< (space << 8 | type) of objects it may create
+      bool                                               global = false;
+
+      bool conflicts_with( const access_set& other )const;
+   };
+
+   /** @return what trx may touch when it is applied with skip flags on top of the current state of db */
+   access_set get_access_set( const database& db, const signed_transaction& trx, uint32_t skip );
+
+   /**
+    *  Assigns every transaction the lowest level above the levels of all earlier transactions it conflicts with.
+    *  Transactions of one level may run in parallel once the lower levels are done, and committing them ordered
+    *  by level and then by position gives the same state as committing them in their original order.
+    */
+   vector<uint32_t> schedule_levels( const vector<access_set>& sets );
+
+   /** what the speculative schedule of the applied blocks would have gained, see database::enable_speculative_verification() */
+   struct speculative_execution_stats
+   {
+      uint64_t blocks           = 0; ///< blocks with at least two transactions whose schedule was verified
+      uint64_t transactions     = 0;
+      uint64_t levels           = 0; ///< sum of the levels of those blocks
+      uint64_t mismatches       = 0; ///< blocks where the schedule failed or gave a different state digest
+      uint64_t serial_us        = 0; ///< time spent applying the transactions of those blocks one by one
+      uint64_t critical_path_us = 0; ///< time when each level only waits for its slowest transaction
+   };
+
+} }
+
+FC_REFLECT( graphene::chain::speculative_execution_stats,
+            (blocks)(transactions)(levels)(mismatches)(serial_us)(critical_path_us) )
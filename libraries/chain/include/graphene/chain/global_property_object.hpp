@@ -25,6 +25,7 @@
 #include <graphene/chain/protocol/types.hpp>
 #include <graphene/chain/database.hpp>
 #include <graphene/db/object.hpp>
+#include <graphene/db/simple_index.hpp>
 
 namespace graphene { namespace chain {
 
@@ -122,6 +123,11 @@ namespace graphene { namespace chain {
    };
 }}
 
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::global_property_object,
+                         graphene::db::simple_index<graphene::chain::global_property_object> )
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::dynamic_global_property_object,
+                         graphene::db::simple_index<graphene::chain::dynamic_global_property_object> )
+
 FC_REFLECT_DERIVED( graphene::chain::dynamic_global_property_object, (graphene::db::object),
                     (head_block_number)
                     (head_block_id)
@@ -76,7 +76,8 @@ namespace graphene { namespace chain {
            composite_key_compare< std::greater<price>, std::less<object_id_type> >
         >,
         ordered_non_unique< tag<by_account>, member<limit_order_object, account_id_type, &limit_order_object::seller>>
-     >
+     >,
+     graphene::db::pool_allocator<limit_order_object>
   > limit_order_multi_index_type;
 
   typedef generic_index<limit_order_object, limit_order_multi_index_type> limit_order_index;
@@ -230,6 +231,10 @@ namespace graphene { namespace chain {
 
 } } // graphene::chain
 
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::limit_order_object, graphene::chain::limit_order_index )
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::call_order_object, graphene::chain::call_order_index )
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::force_settlement_object, graphene::chain::force_settlement_index )
+
 FC_REFLECT_DERIVED( graphene::chain::limit_order_object,
                     (graphene::db::object),
                     (expiration)(seller)(for_sale)(sell_price)(deferred_fee)
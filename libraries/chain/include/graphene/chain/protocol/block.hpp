@@ -49,6 +49,8 @@ namespace graphene { namespace chain {
    struct signed_block : public signed_block_header
    {
       checksum_type calculate_merkle_root()const;
+      /// The merkle root of transactions whose merkle_digest() are the given digests, in order
+      static checksum_type calculate_merkle_root( vector<digest_type> ids );
       vector<processed_transaction> transactions;
    };
 
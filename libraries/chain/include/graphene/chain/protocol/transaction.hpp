@@ -84,6 +84,8 @@ namespace graphene { namespace chain {
       /// Calculate the digest for a transaction
       digest_type         digest()const;
       transaction_id_type id()const;
+      /// The id of the transaction whose digest() is d, for callers which computed the digest already
+      static transaction_id_type id_from_digest( const digest_type& d );
       void                validate() const;
       /// Calculate the digest used for signature validation
       digest_type         sig_digest( const chain_id_type& chain_id )const;
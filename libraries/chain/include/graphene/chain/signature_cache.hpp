@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+#include <graphene/chain/protocol/transaction.hpp>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace graphene { namespace chain {
+
+   struct signature_cache_stats
+   {
+      uint64_t hits     = 0;
+      uint64_t misses   = 0;
+      uint64_t entries  = 0;
+      uint64_t capacity = 0; ///< maximum number of entries
+   };
+
+   /**
+    *  @class signature_cache
+    *  @brief Bounded LRU cache of the keys which signed a transaction
+    *
+    *  A transaction is checked when it is pushed, each time the pending state is rebuilt and once more when it
+    *  arrives inside a block.  Recovering its signing keys is by far the most expensive part of that, and the
+    *  result only depends on the chain id, the transaction and its signatures, so it is looked up here before
+    *  the keys are recovered again.  Transactions whose keys can not be recovered are not cached.  All methods
+    *  may be called from any thread.
+    */
+   class signature_cache
+   {
+      public:
+         static const uint64_t default_capacity = 100000;
+
+         explicit signature_cache( uint64_t capacity );
+
+         /** a capacity of 0 disables the cache */
+         void     set_capacity( uint64_t capacity );
+
+         /** @return trx.get_signature_keys( chain_id ), from the cache if trx was seen before */
+         flat_set<public_key_type> get_signature_keys( const signed_transaction& trx, const chain_id_type& chain_id );
+         /** same as above for callers which computed trx.digest() already */
+         flat_set<public_key_type> get_signature_keys( const signed_transaction& trx, const chain_id_type& chain_id,
+                                                       const digest_type& trx_digest );
+
+         void clear();
+
+         signature_cache_stats stats()const;
+
+      private:
+         struct entry
+         {
+            digest_type                key;
+            flat_set<public_key_type>  keys;
+         };
+         typedef std::list<entry> lru_list;
+
+         struct digest_hash
+         {
+            size_t operator()( const digest_type& d )const { return size_t( d._hash[0] ); }
+         };
+
+         void   evict();
+
+         mutable std::mutex                                               _mutex;
+         lru_list                                                         _lru;    ///< most recently used first
+         std::unordered_map<digest_type, lru_list::iterator, digest_hash> _by_key;
+         signature_cache_stats                                            _stats;
+   };
+
+} }
+
+FC_REFLECT( graphene::chain::signature_cache_stats, (hits)(misses)(entries)(capacity) )
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+#include <graphene/chain/protocol/types.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace fc { class mapped_region; }
+
+namespace graphene { namespace chain {
+
+   struct transaction_location
+   {
+      uint32_t block_num    = 0;
+      uint32_t trx_in_block = 0;
+   };
+
+   struct transaction_history_header;
+   struct transaction_history_slot;
+
+   /**
+    *  @class transaction_history
+    *  @brief On disk hash table from transaction ids to the block and position which included them
+    *
+    *  The table is a memory mapped file of 16 byte slots with open addressing.  A slot only keeps the first 8 bytes
+    *  of the id, so a lookup yields candidate locations which the caller has to verify against the stored blocks.
+    *  Entries are never removed, locations left behind by forks or pruned blocks fail that verification.  The table
+    *  is rebuilt at twice the size when it is half full.
+    *
+    *  Not synchronized, it must only be used from the thread which applies blocks.
+    */
+   class transaction_history
+   {
+      public:
+         transaction_history();
+         ~transaction_history();
+
+         void open( const fc::path& file );
+         bool is_open()const { return _slots != nullptr; }
+         void close();
+
+         /** records that id is transaction trx_in_block of block_num, duplicates are ignored */
+         void add( const transaction_id_type& id, uint32_t block_num, uint32_t trx_in_block );
+         /** @return the locations recorded for ids which begin like id */
+         std::vector<transaction_location> candidates( const transaction_id_type& id )const;
+
+         /** the highest block whose transactions were added, blocks above it are missing from the table */
+         uint32_t last_block()const;
+         void     set_last_block( uint32_t block_num );
+
+         uint64_t size()const;
+         uint64_t capacity()const;
+
+         static const uint64_t initial_capacity = 1 << 20;
+
+      private:
+         void map( uint64_t capacity );
+         /** stores s in the first free slot of its probe sequence */
+         void place( const transaction_history_slot& s );
+         /** moves every entry into a table of twice the capacity */
+         void grow();
+
+         fc::path                             _file;
+         std::unique_ptr<fc::mapped_region>   _region;
+         transaction_history_header*          _header = nullptr;
+         transaction_history_slot*            _slots  = nullptr;
+   };
+
+} }
+
+FC_REFLECT( graphene::chain::transaction_location, (block_num)(trx_in_block) )
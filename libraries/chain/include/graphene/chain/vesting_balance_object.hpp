@@ -184,6 +184,8 @@ namespace graphene { namespace chain {
 
 } } // graphene::chain
 
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::vesting_balance_object, graphene::chain::vesting_balance_index )
+
 FC_REFLECT(graphene::chain::linear_vesting_policy,
            (begin_timestamp)
            (vesting_cliff_seconds)
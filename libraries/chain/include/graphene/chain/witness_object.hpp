@@ -67,6 +67,8 @@ namespace graphene { namespace chain {
    using witness_index = generic_index<witness_object, witness_multi_index_type>;
 } } // graphene::chain
 
+GRAPHENE_DB_TYPED_INDEX( graphene::chain::witness_object, graphene::chain::witness_index )
+
 FC_REFLECT_DERIVED( graphene::chain::witness_object, (graphene::db::object),
                     (witness_account)
                     (last_aslot)
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace graphene { namespace chain {
+
+   /**
+    *  @class worker_pool
+    *  @brief Fixed set of threads which run the iterations of a loop in parallel
+    *
+    *  for_each() hands out the indices of a loop one at a time to the workers and to the calling thread, and returns
+    *  once every call returned.  It is meant for stateless work on the chain thread, e.g. checking the signatures of
+    *  the transactions in a block, the tasks must not touch the object database.
+    */
+   class worker_pool
+   {
+      public:
+         /** starts threads workers, the caller is the only thread doing work if threads is 0 */
+         explicit worker_pool( uint32_t threads );
+         ~worker_pool();
+
+         /**
+          *  Calls task(i) for every i in [0,count).  Once a call throws, the indices above it are skipped, and the
+          *  exception of the lowest index which threw is rethrown, as a serial loop would.  Calls from several
+          *  threads are serialized.
+          */
+         void for_each( size_t count, const std::function<void(size_t)>& task );
+
+         uint32_t size()const { return uint32_t( _workers.size() ); }
+
+      private:
+         struct job
+         {
+            job( size_t c, const std::function<void(size_t)>& t ):count(c),task(t) {}
+
+            const size_t                       count;
+            const std::function<void(size_t)>& task;
+            std::atomic<size_t>                next{0};
+            std::atomic<size_t>                finished{0};
+            std::mutex                         error_mutex;
+            std::atomic<size_t>                error_index{ SIZE_MAX }; ///< lowest index which threw so far
+            std::exception_ptr                 error;
+         };
+
+         void run();
+         /** runs indices of j until none are left, @return true if this finished the last one */
+         static bool work( job& j );
+
+         std::mutex                   _for_each_mutex;
+         std::mutex                   _mutex;
+         std::condition_variable      _job_cv;   ///< signalled when a job was posted or on shutdown
+         std::condition_variable      _done_cv;  ///< signalled when the last index of a job finished
+         std::shared_ptr<job>         _job;
+         uint64_t                     _generation = 0;
+         bool                         _stop = false;
+         std::vector<std::thread>     _workers;
+   };
+
+} }
@@ -58,7 +58,11 @@ void transaction::validate() const
 
 graphene::chain::transaction_id_type graphene::chain::transaction::id() const
 {
-   auto h = digest();
+   return id_from_digest( digest() );
+}
+
+graphene::chain::transaction_id_type graphene::chain::transaction::id_from_digest( const digest_type& h )
+{
    transaction_id_type result;
    memcpy(result._hash, h._hash, std::min(sizeof(result), sizeof(h)));
    return result;
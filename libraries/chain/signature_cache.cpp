@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <graphene/chain/signature_cache.hpp>
+
+#include <fc/io/raw.hpp>
+
+namespace graphene { namespace chain {
+
+signature_cache::signature_cache( uint64_t capacity )
+{
+   _stats.capacity = capacity;
+}
+
+void signature_cache::set_capacity( uint64_t capacity )
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _stats.capacity = capacity;
+   evict();
+}
+
+flat_set<public_key_type> signature_cache::get_signature_keys( const signed_transaction& trx, const chain_id_type& chain_id )
+{
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      if( _stats.capacity == 0 )
+         return trx.get_signature_keys( chain_id );
+   }
+   return get_signature_keys( trx, chain_id, trx.digest() );
+}
+
+flat_set<public_key_type> signature_cache::get_signature_keys( const signed_transaction& trx, const chain_id_type& chain_id,
+                                                               const digest_type& trx_digest )
+{
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      if( _stats.capacity == 0 )
+         return trx.get_signature_keys( chain_id );
+   }
+
+   // the signatures are part of the key, the same transaction signed differently may be signed by other keys
+   digest_type::encoder enc;
+   fc::raw::pack( enc, chain_id );
+   fc::raw::pack( enc, trx_digest );
+   fc::raw::pack( enc, trx.signatures );
+   const digest_type key = enc.result();
+
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      auto itr = _by_key.find( key );
+      if( itr != _by_key.end() )
+      {
+         ++_stats.hits;
+         _lru.splice( _lru.begin(), _lru, itr->second );
+         return itr->second->keys;
+      }
+      ++_stats.misses;
+   }
+
+   // recovered without holding the lock, so that other threads can use the cache meanwhile
+   flat_set<public_key_type> keys = trx.get_signature_keys( chain_id );
+
+   std::lock_guard<std::mutex> lock( _mutex );
+   if( _stats.capacity == 0 || _by_key.find( key ) != _by_key.end() )
+      return keys;
+   _lru.emplace_front();
+   _lru.front().key  = key;
+   _lru.front().keys = keys;
+   _by_key[key] = _lru.begin();
+   ++_stats.entries;
+   evict();
+   return keys;
+}
+
+void signature_cache::evict()
+{
+   while( _stats.entries > _stats.capacity && !_lru.empty() )
+   {
+      _by_key.erase( _lru.back().key );
+      _lru.pop_back();
+      --_stats.entries;
+   }
+}
+
+void signature_cache::clear()
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   _lru.clear();
+   _by_key.clear();
+   _stats.entries = 0;
+}
+
+signature_cache_stats signature_cache::stats()const
+{
+   std::lock_guard<std::mutex> lock( _mutex );
+   return _stats;
+}
+
+} }
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <graphene/chain/transaction_history.hpp>
+
+#include <fc/interprocess/file_mapping.hpp>
+
+#include <cstring>
+#include <fstream>
+
+namespace graphene { namespace chain {
+
+struct transaction_history_header
+{
+   uint64_t magic      = 0;
+   uint64_t capacity   = 0; ///< number of slots, a power of two
+   uint64_t size       = 0; ///< occupied slots
+   uint32_t last_block = 0;
+   uint32_t unused     = 0;
+};
+
+struct transaction_history_slot
+{
+   uint64_t id_prefix    = 0;
+   uint32_t block_num    = 0; ///< 0 marks an empty slot, there is no block 0
+   uint32_t trx_in_block = 0;
+};
+
+static const uint64_t history_magic = 0x3179726f74736968ull; // "history1"
+
+static uint64_t id_prefix( const transaction_id_type& id )
+{
+   uint64_t prefix;
+   std::memcpy( &prefix, id.data(), sizeof(prefix) );
+   return prefix;
+}
+
+transaction_history::transaction_history() {}
+
+transaction_history::~transaction_history()
+{
+   close();
+}
+
+void transaction_history::open( const fc::path& file )
+{ try {
+   close();
+   _file = file;
+   fc::create_directories( file.parent_path() );
+   // an interrupted grow() leaves the old table in place
+   fc::remove( fc::path( file.generic_string() + ".tmp" ) );
+   map( initial_capacity );
+   ilog( "Opened the transaction history with ${n} transactions up to block ${b}", ("n",size())("b",last_block()) );
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+void transaction_history::map( uint64_t capacity )
+{
+   bool created = !fc::exists( _file ) || fc::file_size( _file ) == 0;
+   if( created )
+      std::ofstream( _file.generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
+   if( !created )
+   {
+      transaction_history_header h;
+      std::ifstream in( _file.generic_string().c_str(), std::ifstream::binary );
+      in.read( (char*)&h, sizeof(h) );
+      FC_ASSERT( in && h.magic == history_magic, "${f} is not a transaction history", ("f",_file) );
+      capacity = h.capacity;
+   }
+   const uint64_t bytes = sizeof(transaction_history_header) + capacity * sizeof(transaction_history_slot);
+   if( fc::file_size( _file ) != bytes )
+      fc::resize_file( _file, bytes );
+
+   fc::file_mapping mapping( _file.generic_string().c_str(), fc::read_write );
+   _region.reset( new fc::mapped_region( mapping, fc::read_write, 0, bytes ) );
+   _header = static_cast<transaction_history_header*>( _region->get_address() );
+   _slots  = reinterpret_cast<transaction_history_slot*>( _header + 1 );
+   if( created )
+   {
+      *_header = transaction_history_header();
+      _header->magic    = history_magic;
+      _header->capacity = capacity;
+   }
+}
+
+void transaction_history::close()
+{
+   if( !is_open() )
+      return;
+   _region->flush();
+   _region.reset();
+   _header = nullptr;
+   _slots = nullptr;
+}
+
+void transaction_history::place( const transaction_history_slot& s )
+{
+   const uint64_t mask = _header->capacity - 1;
+   for( uint64_t i = s.id_prefix & mask; ; i = (i + 1) & mask )
+      if( _slots[i].block_num == 0 )
+      {
+         _slots[i] = s;
+         return;
+      }
+}
+
+void transaction_history::add( const transaction_id_type& id, uint32_t block_num, uint32_t trx_in_block )
+{
+   assert( is_open() && block_num != 0 );
+   const uint64_t prefix = id_prefix( id );
+   const uint64_t mask = _header->capacity - 1;
+   for( uint64_t i = prefix & mask; _slots[i].block_num != 0; i = (i + 1) & mask )
+      if( _slots[i].id_prefix == prefix && _slots[i].block_num == block_num && _slots[i].trx_in_block == trx_in_block )
+         return;
+
+   transaction_history_slot s;
+   s.id_prefix    = prefix;
+   s.block_num    = block_num;
+   s.trx_in_block = trx_in_block;
+   place( s );
+   // probe sequences stay short as long as at least half of the slots are free
+   if( ++_header->size * 2 > _header->capacity )
+      grow();
+}
+
+std::vector<transaction_location> transaction_history::candidates( const transaction_id_type& id )const
+{
+   std::vector<transaction_location> result;
+   if( !is_open() )
+      return result;
+   const uint64_t prefix = id_prefix( id );
+   const uint64_t mask = _header->capacity - 1;
+   for( uint64_t i = prefix & mask; _slots[i].block_num != 0; i = (i + 1) & mask )
+      if( _slots[i].id_prefix == prefix )
+      {
+         transaction_location loc;
+         loc.block_num    = _slots[i].block_num;
+         loc.trx_in_block = _slots[i].trx_in_block;
+         result.push_back( loc );
+      }
+   return result;
+}
+
+uint32_t transaction_history::last_block()const
+{
+   return is_open() ? _header->last_block : 0;
+}
+
+void transaction_history::set_last_block( uint32_t block_num )
+{
+   _header->last_block = block_num;
+}
+
+uint64_t transaction_history::size()const
+{
+   return is_open() ? _header->size : 0;
+}
+
+uint64_t transaction_history::capacity()const
+{
+   return is_open() ? _header->capacity : 0;
+}
+
+void transaction_history::grow()
+{ try {
+   const fc::path tmp( _file.generic_string() + ".tmp" );
+   fc::remove( tmp );
+   {
+      transaction_history bigger;
+      bigger._file = tmp;
+      bigger.map( _header->capacity * 2 );
+      for( uint64_t i = 0; i < _header->capacity; ++i )
+         if( _slots[i].block_num != 0 )
+            bigger.place( _slots[i] );
+      bigger._header->size       = _header->size;
+      bigger._header->last_block = _header->last_block;
+   }
+   const fc::path file = _file;
+   close();
+   fc::rename( tmp, file );
+   _file = file;
+   map( initial_capacity );
+   ilog( "Grew the transaction history to ${n} slots", ("n",capacity()) );
+} FC_CAPTURE_AND_RETHROW( (_file) ) }
+
+} }
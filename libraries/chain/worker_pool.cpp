@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <graphene/chain/worker_pool.hpp>
+
+namespace graphene { namespace chain {
+
+worker_pool::worker_pool( uint32_t threads )
+{
+   for( uint32_t i = 0; i < threads; ++i )
+      _workers.emplace_back( [this]() { run(); } );
+}
+
+worker_pool::~worker_pool()
+{
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _stop = true;
+   }
+   _job_cv.notify_all();
+   for( auto& t : _workers )
+      t.join();
+}
+
+bool worker_pool::work( job& j )
+{
+   bool last = false;
+   for( size_t i = j.next++; i < j.count; i = j.next++ )
+   {
+      if( i < j.error_index )
+      {
+         try
+         {
+            j.task( i );
+         }
+         catch( ... )
+         {
+            std::lock_guard<std::mutex> lock( j.error_mutex );
+            if( i < j.error_index )
+            {
+               j.error = std::current_exception();
+               j.error_index = i;
+            }
+         }
+      }
+      last = ( ++j.finished == j.count );
+   }
+   return last;
+}
+
+void worker_pool::run()
+{
+   uint64_t seen = 0;
+   std::unique_lock<std::mutex> lock( _mutex );
+   while( true )
+   {
+      _job_cv.wait( lock, [&]() { return _stop || _generation != seen; } );
+      if( _stop )
+         return;
+      seen = _generation;
+      // the caller may have finished the job alone and cleared it before this thread woke up
+      if( !_job )
+         continue;
+      // holding a reference keeps the job alive if for_each() returns while this thread is still looking at it
+      std::shared_ptr<job> j = _job;
+      lock.unlock();
+      const bool last = work( *j );
+      lock.lock();
+      if( last )
+         _done_cv.notify_all();
+   }
+}
+
+void worker_pool::for_each( size_t count, const std::function<void(size_t)>& task )
+{
+   if( count == 0 )
+      return;
+   std::lock_guard<std::mutex> serialize( _for_each_mutex );
+   auto j = std::make_shared<job>( count, task );
+   if( count > 1 && !_workers.empty() )
+   {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _job = j;
+      ++_generation;
+      _job_cv.notify_all();
+   }
+   work( *j );
+   {
+      std::unique_lock<std::mutex> lock( _mutex );
+      _done_cv.wait( lock, [&]() { return j->finished == j->count; } );
+      _job.reset();
+   }
+   if( j->error )
+      std::rethrow_exception( j->error );
+}
+
+} }
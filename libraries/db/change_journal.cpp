@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <graphene/db/change_journal.hpp>
+#include <graphene/db/durable_file.hpp>
+
+#include <fc/io/raw.hpp>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace graphene { namespace db {
+
+change_journal::~change_journal()
+{
+   close();
+}
+
+void change_journal::open( const fc::path& file, uint32_t sync_interval )
+{ try {
+   close();
+   _path = file;
+   _sync_interval = sync_interval;
+   _unsynced = 0;
+   _file = std::fopen( file.generic_string().c_str(), "ab" );
+   FC_ASSERT( _file != nullptr, "Unable to open change journal" );
+} FC_CAPTURE_AND_RETHROW( (file)(sync_interval) ) }
+
+void change_journal::close()
+{
+   if( _file == nullptr ) return;
+   sync();
+   std::fclose( _file );
+   _file = nullptr;
+}
+
+void change_journal::append( const journal_record& rec )
+{ try {
+   FC_ASSERT( is_open() );
+   const auto framed = frame_record( fc::raw::pack( rec ) );
+   FC_ASSERT( std::fwrite( framed.data(), framed.size(), 1, _file ) == 1 );
+   std::fflush( _file );
+   if( _sync_interval != 0 && ++_unsynced >= _sync_interval )
+      sync();
+} FC_CAPTURE_AND_RETHROW() }
+
+void change_journal::sync()
+{
+   if( _file == nullptr ) return;
+   std::fflush( _file );
+#ifdef _WIN32
+   _commit( _fileno( _file ) );
+#else
+   fsync( fileno( _file ) );
+#endif
+   _unsynced = 0;
+}
+
+void change_journal::reset()
+{ try {
+   FC_ASSERT( is_open() );
+   std::fclose( _file );
+   _file = std::fopen( _path.generic_string().c_str(), "wb" );
+   FC_ASSERT( _file != nullptr, "Unable to truncate change journal" );
+   sync();
+} FC_CAPTURE_AND_RETHROW( (_path) ) }
+
+uint32_t change_journal::replay( const fc::path& file, const std::function<void(const journal_record&)>& f )
+{
+   // cut torn or corrupt records so that the records appended after reopening the journal are found again
+   return read_framed_records( file, [&]( const vector<char>& data ) {
+      f( fc::raw::unpack<journal_record>( data ) );
+   }, true );
+}
+
+} } // graphene::db
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <graphene/db/durable_file.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/crypto/sha256.hpp>
+
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace graphene { namespace db {
+
+namespace {
+   struct record_header
+   {
+      uint32_t size = 0;
+      uint64_t checksum = 0;
+   };
+
+   uint64_t record_checksum( const char* data, size_t size )
+   {
+      return fc::sha256::hash( data, size )._hash[0];
+   }
+}
+
+void sync_file( const fc::path& file )
+{
+#ifdef _WIN32
+   HANDLE h = CreateFileW( file.generic_wstring().c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+   FC_ASSERT( h != INVALID_HANDLE_VALUE, "Unable to open ${f} for syncing", ("f",file) );
+   const bool ok = FlushFileBuffers( h );
+   CloseHandle( h );
+#else
+   const int fd = ::open( file.generic_string().c_str(), O_RDONLY );
+   FC_ASSERT( fd >= 0, "Unable to open ${f} for syncing", ("f",file) );
+   const bool ok = ::fsync( fd ) == 0;
+   ::close( fd );
+#endif
+   FC_ASSERT( ok, "Unable to sync ${f}", ("f",file) );
+}
+
+void sync_directory( const fc::path& dir )
+{
+#ifndef _WIN32
+   // NTFS commits directory entries with its metadata journal, directories cannot be opened for syncing there
+   const int fd = ::open( dir.generic_string().c_str(), O_RDONLY );
+   FC_ASSERT( fd >= 0, "Unable to open ${d} for syncing", ("d",dir) );
+   const bool ok = ::fsync( fd ) == 0;
+   ::close( fd );
+   FC_ASSERT( ok, "Unable to sync ${d}", ("d",dir) );
+#endif
+}
+
+std::vector<char> frame_record( const std::vector<char>& data )
+{
+   record_header header;
+   header.size = data.size();
+   header.checksum = record_checksum( data.data(), data.size() );
+   std::vector<char> framed( sizeof(header) + data.size() );
+   memcpy( framed.data(), &header, sizeof(header) );
+   std::copy( data.begin(), data.end(), framed.begin() + sizeof(header) );
+   return framed;
+}
+
+void append_framed_record( const fc::path& file, const std::vector<char>& data )
+{ try {
+   const auto framed = frame_record( data );
+   {
+      std::ofstream out( file.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::app );
+      FC_ASSERT( out, "Unable to open ${f}", ("f",file) );
+      out.write( framed.data(), framed.size() );
+      FC_ASSERT( out, "Unable to write to ${f}", ("f",file) );
+   }
+   sync_file( file );
+} FC_CAPTURE_AND_RETHROW( (file) ) }
+
+uint32_t read_framed_records( const fc::path& file, const std::function<void(const std::vector<char>&)>& f,
+                              bool truncate )
+{ try {
+   if( !fc::exists( file ) ) return 0;
+   const uint64_t file_size = fc::file_size( file );
+   uint64_t good = 0;
+   uint32_t count = 0;
+   {
+      std::ifstream in( file.generic_string(), std::ifstream::binary | std::ifstream::in );
+      FC_ASSERT( in, "Unable to read ${f}", ("f",file) );
+
+      std::vector<char> data;
+      while( good + sizeof(record_header) <= file_size )
+      {
+         record_header header;
+         in.read( (char*)&header, sizeof(header) );
+         // a zero filled tail has size 0, which no record written by append_framed_record has
+         if( !in || header.size == 0 || header.size > file_size - good - sizeof(header) )
+            break;
+         data.resize( header.size );
+         in.read( data.data(), data.size() );
+         if( !in || record_checksum( data.data(), data.size() ) != header.checksum )
+            break;
+         f( data );
+         good += sizeof(header) + header.size;
+         ++count;
+      }
+   }
+   if( good < file_size )
+   {
+      wlog( "Ignoring ${n} bytes after record ${c} of ${f}", ("n",file_size - good)("c",count)("f",file) );
+      if( truncate )
+      {
+         fc::resize_file( file, good );
+         sync_file( file );
+      }
+   }
+   return count;
+} FC_CAPTURE_AND_RETHROW( (file)(truncate) ) }
+
+} } // graphene::db
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+#include <graphene/db/index.hpp>
+
+#include <cstdio>
+#include <functional>
+
+namespace graphene { namespace db {
+
+   /**
+    *  All objects changed between two commits of the journal, with the next ids of
+    *  the indexes they belong to, so that a record can be applied atomically.
+    */
+   struct journal_record
+   {
+      vector<object_id_type> next_ids;
+      vector<object_delta>   objects;
+   };
+
+   /**
+    *  @class change_journal
+    *  @brief append-only, checksummed log of journal_records
+    *
+    *  Each record is framed by its size and checksum so that a record torn by a crash
+    *  is detected and ignored on replay.  The journal is fsynced every sync_interval
+    *  records, a sync_interval of 0 leaves flushing to the operating system.
+    */
+   class change_journal
+   {
+      public:
+         ~change_journal();
+
+         void open( const fc::path& file, uint32_t sync_interval );
+         bool is_open()const { return _file != nullptr; }
+         void close();
+
+         void append( const journal_record& rec );
+         void sync();
+
+         /** discards every record, called once their changes are covered by a checkpoint */
+         void reset();
+
+         /**
+          *  Calls f with every intact record of the journal at file in order, and truncates the
+          *  journal after the last of them.
+          *  @return the number of records replayed
+          */
+         static uint32_t replay( const fc::path& file, const std::function<void(const journal_record&)>& f );
+
+      private:
+         fc::path  _path;
+         FILE*     _file = nullptr;
+         uint32_t  _sync_interval = 1;
+         uint32_t  _unsynced = 0;
+   };
+
+} } // graphene::db
+
+FC_REFLECT( graphene::db::journal_record, (next_ids)(objects) )
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+#include <fc/filesystem.hpp>
+
+#include <functional>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /** flushes the contents of file to disk */
+   void sync_file( const fc::path& file );
+
+   /** flushes the entries of dir to disk so that files created, renamed or removed in it survive a crash */
+   void sync_directory( const fc::path& dir );
+
+   /** @return data prefixed by its size and checksum, the unit written by append_framed_record */
+   std::vector<char> frame_record( const std::vector<char>& data );
+
+   /**
+    *  Appends data to file framed by its size and checksum, then fsyncs the file.  Framed records
+    *  are the format of the change journal and of the delta files written by index checkpoints.
+    */
+   void append_framed_record( const fc::path& file, const std::vector<char>& data );
+
+   /**
+    *  Calls f with the payload of every intact framed record of file in order, stopping at the first
+    *  record which is torn, zero filled or fails its checksum.
+    *
+    *  @param truncate cut the file after the last intact record so that later appends are not lost behind garbage
+    *  @return the number of intact records
+    */
+   uint32_t read_framed_records( const fc::path& file, const std::function<void(const std::vector<char>&)>& f,
+                                 bool truncate );
+
+} } // graphene::db
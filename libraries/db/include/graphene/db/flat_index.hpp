@@ -20,16 +20,18 @@
  */
 #pragma once
 #include <graphene/db/index.hpp>
+#include <graphene/db/slab_vector.hpp>
 
 namespace graphene { namespace db {
 
    /**
     *  @class flat_index
-    *  @brief A flat index uses a vector<T> to store data
+    *  @brief A flat index stores every instance up to size() in a slab_vector<T>
     *
     *  This index is preferred in situations where the data will never be
     *  removed from main memory and when lots of small objects that
-    *  are accessed in order are required.
+    *  are accessed in order are required.  Growing the index does not
+    *  move existing objects.
     */
    template<typename T>
    class flat_index : public index
@@ -41,33 +43,42 @@ namespace graphene { namespace db {
          {
              auto id = get_next_id();
              auto instance = id.instance();
-             if( instance >= _objects.size() ) _objects.resize( instance + 1 );
-             _objects[instance].id = id;
-             constructor( _objects[instance] );
+             if( instance >= _objects.size() ) grow( instance + 1 );
+             T& obj = *_objects.find( instance );
+             obj.id = id;
+             constructor( obj );
              use_next_id();
-             return _objects[instance];
+             return obj;
          }
 
          virtual void modify( const object& obj, const std::function<void(object&)>& modify_callback ) override
          {
             assert( obj.id.instance() < _objects.size() );
-            modify_callback( _objects[obj.id.instance()] );
+            modify_callback( *_objects.find( obj.id.instance() ) );
+         }
+
+         template<typename Lambda>
+         void modify_typed( const T& obj, const Lambda& m )
+         {
+            assert( obj.id.instance() < _objects.size() );
+            m( *_objects.find( obj.id.instance() ) );
          }
 
          virtual const object& insert( object&& obj )override
          {
             auto instance = obj.id.instance();
             assert( nullptr != dynamic_cast<T*>(&obj) );
-            if( _objects.size() <= instance ) _objects.resize( instance+1 );
-            _objects[instance] = std::move( static_cast<T&>(obj) );
-            return _objects[instance];
+            if( _objects.size() <= instance ) grow( instance+1 );
+            T& slot = *_objects.find( instance );
+            slot = std::move( static_cast<T&>(obj) );
+            return slot;
          }
 
          virtual void remove( const object& obj ) override
          {
             assert( nullptr != dynamic_cast<const T*>(&obj) );
             const auto instance = obj.id.instance();
-            _objects[instance] = T();
+            *_objects.find( instance ) = T();
          }
 
          virtual const object* find( object_id_type id )const override
@@ -75,26 +86,22 @@ namespace graphene { namespace db {
             assert( id.space() == T::space_id );
             assert( id.type() == T::type_id );
 
-            const auto instance = id.instance();
-            if( instance >= _objects.size() ) return nullptr;
-            return &_objects[instance];
+            return _objects.find( id.instance() );
          }
 
          virtual void inspect_all_objects(std::function<void (const object&)> inspector)const override
          {
             try {
-               for( const auto& ptr : _objects )
-               {
-                  inspector(ptr);
-               }
+               _objects.for_each( [&]( const T& obj ) { inspector( obj ); } );
             } FC_CAPTURE_AND_RETHROW()
          }
 
+         /** placeholder slots, which were never created or were removed, do not carry their own id */
          virtual fc::uint128 hash()const override {
             fc::uint128 result;
-            for( const auto& ptr : _objects )
-               result += ptr.hash();
-
+            for( auto itr = _objects.begin(); itr != _objects.end(); ++itr )
+               if( itr->id == object_id_type( T::space_id, T::type_id, itr.position() ) )
+                  result += itr->hash();
             return result;
          }
 
@@ -102,28 +109,36 @@ namespace graphene { namespace db {
          {
             public:
                const_iterator(){}
-               const_iterator( const typename vector<T>::const_iterator& a ):_itr(a){}
+               const_iterator( const typename slab_vector<T>::const_iterator& a ):_itr(a){}
                friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._itr == b._itr; }
                friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._itr != b._itr; }
-               const T* operator*()const { return static_cast<const T*>(&*_itr); }
+               const T* operator*()const { return &*_itr; }
                const_iterator& operator++(int){ ++_itr; return *this; }
                const_iterator& operator++()   { ++_itr; return *this; }
             private:
-               typename vector<T>::const_iterator _itr;
+               typename slab_vector<T>::const_iterator _itr;
          };
          const_iterator begin()const { return const_iterator(_objects.begin()); }
          const_iterator end()const   { return const_iterator(_objects.end());   }
 
          size_t size()const{ return _objects.size(); }
+         void reserve( size_t n ) { _objects.reserve( n ); }
 
-         void resize( uint32_t s ) { 
-            _objects.resize(s); 
+         void resize( uint32_t s ) {
+            while( _objects.size() > s )
+               _objects.erase( _objects.size() - 1 );
+            grow( s );
             for( uint32_t i = 0; i < s; ++i )
-               _objects[i].id = object_id_type(object_type::space_id,object_type::type_id,i);
+               _objects.find(i)->id = object_id_type(object_type::space_id,object_type::type_id,i);
          }
 
       private:
-         vector< T > _objects;
+         void grow( size_t s ) {
+            for( size_t i = _objects.size(); i < s; ++i )
+               _objects.emplace( i );
+         }
+
+         slab_vector< T > _objects;
    };
 
 } } // graphene::db
@@ -20,6 +20,7 @@
  */
 #pragma once
 #include <graphene/db/index.hpp>
+#include <graphene/db/node_pool.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -35,8 +36,12 @@ namespace graphene { namespace chain {
     *  Almost all objects can be tracked and managed via a boost::multi_index container that uses
     *  an unordered_unique key on the object ID.  This template class adapts the generic index interface
     *  to work with arbitrary boost multi_index containers on the same type.
+    *
+    *  With DenseIds the index also keeps a vector of object pointers addressed by id instance so that
+    *  find() is a single array access instead of a tree walk.  The vector spans every instance ever
+    *  created, enable it for object types which are rarely removed such as accounts and balances.
     */
-   template<typename ObjectType, typename MultiIndexType>
+   template<typename ObjectType, typename MultiIndexType, bool DenseIds = false>
    class generic_index : public index
    {
       public:
@@ -48,6 +53,7 @@ namespace graphene { namespace chain {
             assert( nullptr != dynamic_cast<ObjectType*>(&obj) );
             auto insert_result = _indices.insert( std::move( static_cast<ObjectType&>(obj) ) );
             FC_ASSERT( insert_result.second, "Could not insert object, most likely a uniqueness constraint was violated" );
+            track( *insert_result.first );
             return *insert_result.first;
          }
 
@@ -58,6 +64,7 @@ namespace graphene { namespace chain {
             constructor( item );
             auto insert_result = _indices.insert( std::move(item) );
             FC_ASSERT(insert_result.second, "Could not create object! Most likely a uniqueness constraint is violated.");
+            track( *insert_result.first );
             use_next_id();
             return *insert_result.first;
          }
@@ -70,13 +77,27 @@ namespace graphene { namespace chain {
             FC_ASSERT( ok, "Could not modify object, most likely a index constraint was violated" );
          }
 
+         template<typename Lambda>
+         void modify_typed( const ObjectType& obj, const Lambda& m )
+         {
+            auto ok = _indices.modify( _indices.iterator_to( obj ), [&m]( ObjectType& o ){ m(o); } );
+            FC_ASSERT( ok, "Could not modify object, most likely a index constraint was violated" );
+         }
+
          virtual void remove( const object& obj )override
          {
+            untrack( obj.id );
             _indices.erase( _indices.iterator_to( static_cast<const ObjectType&>(obj) ) );
          }
 
          virtual const object* find( object_id_type id )const override
          {
+            if( DenseIds )
+            {
+               assert( id.space() == ObjectType::space_id && id.type() == ObjectType::type_id );
+               const auto instance = id.instance();
+               return instance < _by_instance.size() ? _by_instance[instance] : nullptr;
+            }
             auto itr = _indices.find( id );
             if( itr == _indices.end() ) return nullptr;
             return &*itr;
@@ -92,6 +113,17 @@ namespace graphene { namespace chain {
 
          const index_type& indices()const { return _indices; }
 
+         /** Node pool occupancy if MultiIndexType was declared with a graphene::db::pool_allocator */
+         virtual fc::optional<graphene::db::node_pool_stats> pool_stats()const override
+         {
+            return graphene::db::get_pool_stats( _indices.get_allocator() );
+         }
+
+         virtual const void* pool_id()const override
+         {
+            return graphene::db::get_pool_id( _indices.get_allocator() );
+         }
+
          virtual fc::uint128 hash()const override {
             fc::uint128 result;
             for( const auto& ptr : _indices )
@@ -102,9 +134,30 @@ namespace graphene { namespace chain {
             return result;
          }
 
+         void reserve( size_t n ) { if( DenseIds ) _by_instance.reserve( n ); }
+
       private:
-         fc::uint128 _current_hash;
-         index_type  _indices;
+         void track( const ObjectType& obj )
+         {
+            if( !DenseIds ) return;
+            const auto instance = obj.id.instance();
+            if( instance >= _by_instance.size() )
+               _by_instance.resize( instance + 1, nullptr );
+            _by_instance[instance] = &obj;
+         }
+         void untrack( object_id_type id )
+         {
+            if( !DenseIds ) return;
+            const auto instance = id.instance();
+            if( instance < _by_instance.size() )
+               _by_instance[instance] = nullptr;
+            while( !_by_instance.empty() && _by_instance.back() == nullptr )
+               _by_instance.pop_back();
+         }
+
+         fc::uint128                    _current_hash;
+         index_type                     _indices;
+         vector<const ObjectType*>      _by_instance;
    };
 
    /**
@@ -19,6 +19,8 @@
  *
  */
 #pragma once
+#include <graphene/db/durable_file.hpp>
+#include <graphene/db/node_pool.hpp>
 #include <graphene/db/object.hpp>
 #include <graphene/db/type_serializer.hpp>
 #include <fc/interprocess/file_mapping.hpp>
@@ -26,11 +28,31 @@
 #include <fc/io/json.hpp>
 #include <fc/crypto/sha256.hpp>
 #include <fstream>
+#include <unordered_set>
 
 namespace graphene { namespace db {
    class object_database;
    using fc::path;
 
+   /**
+    *  The current packed value of an object that changed since the last checkpoint, an
+    *  empty data vector means the object was removed.
+    */
+   struct object_delta
+   {
+      object_id_type id;
+      vector<char>   data;
+   };
+
+   /**
+    *  A record appended to the delta file of an index by each checkpoint.
+    */
+   struct index_delta
+   {
+      object_id_type       next_id;
+      vector<object_delta> objects;
+   };
+
    /**
     * @class index_observer
     * @brief used to get callbacks when objects change
@@ -76,6 +98,10 @@ namespace graphene { namespace db {
          virtual void           set_next_id( object_id_type id ) = 0;
 
          virtual const object&  load( const std::vector<char>& data ) = 0;
+
+         /** hint that about n objects are about to be loaded, indexes with contiguous storage hide this */
+         void reserve( size_t n ) {}
+
          /**
           *  Polymorphically insert by moving an object into the index.
           *  this should throw if the object is already in the database.
@@ -94,6 +120,18 @@ namespace graphene { namespace db {
          virtual void open( const fc::path& db ) = 0;
          virtual void save( const fc::path& db ) = 0;
 
+         /**
+          *  Appends the objects which changed since the last save or checkpoint to the
+          *  delta file next to db, rewriting the whole index once the delta outgrows it.
+          */
+         virtual void checkpoint( const fc::path& db ) = 0;
+
+         /**
+          *  Replaces, inserts or removes the object in delta without recording undo
+          *  history, used to roll saved changes forward.
+          */
+         virtual void apply_delta( const object_delta& delta ) = 0;
+
 
 
          /** @return the object with id or nullptr if not found */
@@ -128,6 +166,11 @@ namespace graphene { namespace db {
          virtual fc::uint128        hash()const = 0;
          virtual void               add_observer( const shared_ptr<index_observer>& ) = 0;
 
+         /** Node pool occupancy, empty unless the index allocates its nodes from a graphene::db::node_pool */
+         virtual fc::optional<node_pool_stats> pool_stats()const { return fc::optional<node_pool_stats>(); }
+         /** Identifies the node pool behind pool_stats(), indexes with the same id share one pool */
+         virtual const void*                   pool_id()const { return nullptr; }
+
    };
 
    class secondary_index
@@ -160,6 +203,9 @@ namespace graphene { namespace db {
          /** called just after obj is modified */
          void on_modify( const object& obj );
 
+         /** records that obj changed since the last checkpoint */
+         void mark_dirty( const object& obj );
+
          template<typename T>
          void add_secondary_index()
          {
@@ -177,9 +223,31 @@ namespace graphene { namespace db {
             FC_THROW_EXCEPTION( fc::assert_exception, "invalid index type" );
          }
 
+         /** @return the ids of all objects created, modified or removed since the last save or checkpoint */
+         const std::unordered_set<object_id_type>& dirty_objects()const { return _dirty; }
+
+         /**
+          * The sum of object::hash() over every object in the index, kept up to date on each change once
+          * seeded by reset_digest().  Addition makes it independent of the order in which objects changed.
+          */
+         const fc::uint128& digest()const { return _digest; }
+         bool digest_enabled()const { return _digest_enabled; }
+         void reset_digest( const fc::uint128& initial ) { _digest = initial; _digest_enabled = true; }
+
+         /** whether the index is part of object_database::state_digest() */
+         bool in_state_digest()const { return _in_state_digest; }
+         void set_in_state_digest( bool in ) { _in_state_digest = in; }
+
       protected:
+         void digest_add( const object& obj )    { if( _digest_enabled ) _digest += obj.hash(); }
+         void digest_remove( const object& obj ) { if( _digest_enabled ) _digest -= obj.hash(); }
+
          vector< shared_ptr<index_observer> >   _observers;
          vector< unique_ptr<secondary_index> >  _sindex;
+         std::unordered_set<object_id_type>     _dirty;
+         fc::uint128                            _digest;
+         bool                                   _digest_enabled = false;
+         bool                                   _in_state_digest = false;
 
       private:
          object_database& _db;
@@ -220,6 +288,7 @@ namespace graphene { namespace db {
 
          virtual void open( const path& db )override
          { 
+            recover_save( db );
             if( !fc::exists( db ) ) return;
             fc::file_mapping fm( db.generic_string().c_str(), fc::read_only );
             fc::mapped_region mr( fm, fc::read_only, 0, fc::file_size(db) );
@@ -229,39 +298,109 @@ namespace graphene { namespace db {
             fc::raw::unpack(ds, _next_id);
             fc::raw::unpack(ds, open_ver);
             FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
+            // instances are allocated sequentially, so the next id bounds the number of objects
+            DerivedIndex::reserve( _next_id.instance() );
             try {
-               vector<char> tmp;
-               while( true ) 
+               while( ds.remaining() )
                {
-                  fc::raw::unpack( ds, tmp );
-                  load( tmp );
+                  unsigned_int size;
+                  fc::raw::unpack( ds, size );
+                  FC_ASSERT( size.value <= ds.remaining() );
+                  // unpack straight from the mapped file instead of copying each object out first
+                  fc::datastream<const char*> object_ds( ds.pos(), size.value );
+                  object_type obj;
+                  fc::raw::unpack( object_ds, obj );
+                  ds.skip( size.value );
+                  load_object( std::move(obj) );
                }
             } catch ( const fc::exception&  ){}
+
+            load_delta( delta_path( db ) );
          }
 
+         /**
+          *  Replaces the snapshot at db and drops its delta file.  The delta is renamed out of the way
+          *  before the new snapshot takes its place so that a crash can never leave deltas of the old
+          *  snapshot next to the new one, recover_save() finishes a save interrupted in between.
+          */
          virtual void save( const path& db ) override 
          {
-            std::ofstream out( db.generic_string(), 
-                               std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
-            FC_ASSERT( out );
-            auto ver  = get_object_version();
-            fc::raw::pack( out, _next_id );
-            fc::raw::pack( out, ver );
-            this->inspect_all_objects( [&]( const object& o ) {
-                auto vec = fc::raw::pack( static_cast<const object_type&>(o) );
-                auto packed_vec = fc::raw::pack( vec );
-                out.write( packed_vec.data(), packed_vec.size() );
-            });
+            recover_save( db );
+            const path tmp = tmp_path( db );
+            {
+               std::ofstream out( tmp.generic_string(), 
+                                  std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+               FC_ASSERT( out );
+               auto ver  = get_object_version();
+               fc::raw::pack( out, _next_id );
+               fc::raw::pack( out, ver );
+               this->inspect_all_objects( [&]( const object& o ) {
+                   auto vec = fc::raw::pack( static_cast<const object_type&>(o) );
+                   auto packed_vec = fc::raw::pack( vec );
+                   out.write( packed_vec.data(), packed_vec.size() );
+               });
+               FC_ASSERT( out, "Unable to write ${f}", ("f",tmp) );
+            }
+            sync_file( tmp );
+            const path dir = db.parent_path();
+            if( fc::exists( delta_path( db ) ) )
+            {
+               fc::rename( delta_path( db ), stale_delta_path( db ) );
+               sync_directory( dir );
+            }
+            fc::rename( tmp, db );
+            sync_directory( dir );
+            if( fc::exists( stale_delta_path( db ) ) )
+               fc::remove( stale_delta_path( db ) );
+            _dirty.clear();
          }
 
-         virtual const object&  load( const std::vector<char>& data )override
+         virtual void checkpoint( const path& db ) override
          {
-            const auto& result = DerivedIndex::insert( fc::raw::unpack<object_type>( data ) );
-            for( const auto& item : _sindex )
-               item->object_inserted( result );
+            if( !fc::exists( db ) )
+            {
+               save( db );
+               return;
+            }
+            if( _dirty.empty() )
+               return;
+
+            index_delta delta;
+            delta.next_id = _next_id;
+            delta.objects.reserve( _dirty.size() );
+            for( const auto& id : _dirty )
+            {
+               object_delta item;
+               item.id = id;
+               const object* obj = DerivedIndex::find( id );
+               // flat_index keeps a default constructed placeholder in place of removed objects
+               if( obj != nullptr && obj->id == id )
+                  item.data = fc::raw::pack( static_cast<const object_type&>(*obj) );
+               delta.objects.emplace_back( std::move(item) );
+            }
+
+            const path delta_file = delta_path( db );
+            append_framed_record( delta_file, fc::raw::pack( delta ) );
+            _dirty.clear();
+
+            // compact once replaying the deltas would cost more than reading a fresh snapshot
+            if( fc::file_size( delta_file ) > fc::file_size( db ) )
+               save( db );
+         }
+
+         virtual const object& insert( object&& obj ) override
+         {
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            mark_dirty( result );
+            digest_add( result );
             return result;
          }
 
+         virtual const object&  load( const std::vector<char>& data )override
+         {
+            return load_object( fc::raw::unpack<object_type>( data ) );
+         }
+
 
          virtual const object&  create(const std::function<void(object&)>& constructor )override
          {
@@ -291,13 +430,122 @@ namespace graphene { namespace db {
             on_modify( obj );
          }
 
+         /**
+          * Statically typed counterpart of modify() used by object_database::modify for objects whose index
+          * type is known at compile time, the modifier is inlined into the concrete index instead of being
+          * wrapped in a std::function and dispatched through the virtual interface.
+          */
+         template<typename Lambda>
+         void modify_typed( const object_type& obj, const Lambda& m )
+         {
+            save_undo( obj );
+            if( _sindex.empty() )
+            {
+               DerivedIndex::modify_typed( obj, m );
+               on_modify( obj );
+               return;
+            }
+            for( const auto& item : _sindex )
+               item->about_to_modify( obj );
+            DerivedIndex::modify_typed( obj, m );
+            for( const auto& item : _sindex )
+               item->object_modified( obj );
+            on_modify( obj );
+         }
+
+         virtual void apply_delta( const object_delta& delta ) override
+         {
+            const object* existing = DerivedIndex::find( delta.id );
+            if( existing != nullptr && existing->id == delta.id )
+            {
+               for( const auto& item : _sindex )
+                  item->object_removed( *existing );
+               digest_remove( *existing );
+               DerivedIndex::remove( *existing );
+            }
+            if( !delta.data.empty() )
+               load( delta.data );
+            _dirty.insert( delta.id );
+         }
+
          virtual void add_observer( const shared_ptr<index_observer>& o ) override
          {
             _observers.emplace_back( o );
          }
 
       private:
+         static path delta_path( const path& db )       { return db.generic_string() + ".delta"; }
+         static path stale_delta_path( const path& db ) { return db.generic_string() + ".delta.stale"; }
+         static path tmp_path( const path& db )         { return db.generic_string() + ".tmp"; }
+
+         /**
+          *  Completes or rolls back a save() interrupted by a crash.  A stale delta means the new snapshot
+          *  was already synced when the delta was moved aside, so a leftover tmp file is complete and
+          *  replaces the snapshot.  Without a stale delta the old snapshot and its delta are intact and
+          *  a leftover tmp file may be partial.
+          */
+         static void recover_save( const path& db )
+         {
+            const path tmp = tmp_path( db );
+            if( fc::exists( stale_delta_path( db ) ) )
+            {
+               if( fc::exists( tmp ) )
+               {
+                  fc::rename( tmp, db );
+                  sync_directory( db.parent_path() );
+               }
+               fc::remove( stale_delta_path( db ) );
+            }
+            else if( fc::exists( tmp ) )
+               fc::remove( tmp );
+         }
+
+         const object& load_object( object_type&& obj )
+         {
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            for( const auto& item : _sindex )
+               item->object_inserted( result );
+            digest_add( result );
+            return result;
+         }
+
+         /**
+          *  Rolls the records written by checkpoint() forward on top of the loaded snapshot.  Records
+          *  after a torn or corrupt one are cut off so that later checkpoints append to intact data.
+          */
+         void load_delta( const path& delta_file )
+         {
+            read_framed_records( delta_file, [&]( const vector<char>& data ) {
+               auto delta = fc::raw::unpack<index_delta>( data );
+               for( const auto& item : delta.objects )
+                  apply_delta( item );
+               _next_id = delta.next_id;
+            }, true );
+            // everything loaded so far is already on disk
+            _dirty.clear();
+         }
+
          object_id_type _next_id;
    };
 
+   /**
+    * Maps an object type to the primary_index it is registered with so that object_database can reach the
+    * concrete index at compile time.  Object types without a mapping are modified through the virtual
+    * interface, specializations are declared with GRAPHENE_DB_TYPED_INDEX.
+    */
+   template<typename ObjectType>
+   struct typed_index { typedef void type; };
+
 } } // graphene::db
+
+/**
+ * Declares that OBJECT is stored in primary_index<INDEX>, must be used at global scope next to the
+ * definition of INDEX and must match the index passed to object_database::add_index.
+ */
+#define GRAPHENE_DB_TYPED_INDEX( OBJECT, INDEX ) \
+   namespace graphene { namespace db { \
+      template<> struct typed_index< OBJECT > { typedef primary_index< INDEX > type; }; \
+   } }
+
+FC_REFLECT( graphene::db::object_delta, (id)(data) )
+FC_REFLECT( graphene::db::index_delta, (next_id)(objects) )
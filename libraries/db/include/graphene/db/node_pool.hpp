@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+#include <fc/reflect/reflect.hpp>
+#include <fc/optional.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   struct node_pool_stats
+   {
+      uint64_t slot_size   = 0; ///< bytes per node, 0 until the first node is allocated
+      uint64_t chunks      = 0;
+      uint64_t capacity    = 0; ///< nodes that fit in the allocated chunks
+      uint64_t in_use      = 0;
+      uint64_t allocations = 0; ///< nodes handed out since startup
+      uint64_t fallbacks   = 0; ///< requests passed to operator new, i.e. arrays and mismatched sizes
+   };
+
+   /**
+    *  @class node_pool
+    *  @brief Fixed size slab allocator shared by every pool_allocator with the same Tag
+    *
+    *  Freed nodes are kept on an intrusive free list and reused, chunks are never returned so that a
+    *  container which churns through nodes settles on a fixed footprint instead of fragmenting the heap.
+    *  The slot size is taken from the first single node request, containers only allocate one node type
+    *  so other requests are rare and go to operator new.
+    *
+    *  The pool is not synchronized, every container using a Tag must be modified from a single thread.
+    */
+   template<typename Tag>
+   class node_pool
+   {
+      public:
+         static node_pool& instance()
+         {
+            // intentionally leaked, containers with static storage may outlive a function local pool
+            static node_pool* pool = new node_pool;
+            return *pool;
+         }
+
+         void* allocate( size_t size, size_t align )
+         {
+            if( _stats.slot_size == 0 )
+            {
+               _align = std::max( align, alignof(free_node) );
+               _stats.slot_size = (std::max( size, sizeof(free_node) ) + _align - 1) / _align * _align;
+            }
+            if( size > _stats.slot_size || align > _align )
+            {
+               ++_stats.fallbacks;
+               return ::operator new( size );
+            }
+            if( _free == nullptr )
+               grow();
+            free_node* n = _free;
+            _free = n->next;
+            ++_stats.in_use;
+            ++_stats.allocations;
+            return n;
+         }
+
+         void deallocate( void* p, size_t size, size_t align )
+         {
+            if( size > _stats.slot_size || align > _align )
+            {
+               ::operator delete( p );
+               return;
+            }
+            free_node* n = static_cast<free_node*>( p );
+            n->next = _free;
+            _free = n;
+            --_stats.in_use;
+         }
+
+         const node_pool_stats& stats()const { return _stats; }
+
+      private:
+         struct free_node { free_node* next; };
+
+         node_pool() {}
+
+         void grow()
+         {
+            // chunks double up to 64k nodes, small pools stay small and busy ones make few system calls
+            const size_t count = std::min<size_t>( std::max<size_t>( _stats.capacity, 64 ), 64 * 1024 );
+            const size_t bytes = count * _stats.slot_size + _align;
+            _chunks.emplace_back( new char[bytes] );
+            void* base = _chunks.back().get();
+            size_t space = bytes;
+            char* slot = static_cast<char*>( std::align( _align, count * _stats.slot_size, base, space ) );
+            for( size_t i = 0; i < count; ++i, slot += _stats.slot_size )
+            {
+               free_node* n = reinterpret_cast<free_node*>( slot );
+               n->next = _free;
+               _free = n;
+            }
+            ++_stats.chunks;
+            _stats.capacity += count;
+         }
+
+         std::vector< std::unique_ptr<char[]> > _chunks;
+         free_node*                             _free  = nullptr;
+         size_t                                 _align = alignof(free_node);
+         node_pool_stats                        _stats;
+   };
+
+   /**
+    *  Stateless allocator serving single nodes from node_pool<Tag>, pass it as the allocator of a
+    *  multi_index_container to pool that container's nodes.  Tag defaults to the value type so every
+    *  container gets its own pool, containers given the same Tag share one.
+    */
+   template<typename T, typename Tag = T>
+   class pool_allocator
+   {
+      public:
+         typedef T         value_type;
+         typedef T*        pointer;
+         typedef const T*  const_pointer;
+         typedef T&        reference;
+         typedef const T&  const_reference;
+         typedef size_t    size_type;
+         typedef ptrdiff_t difference_type;
+         typedef Tag       pool_tag;
+
+         template<typename U>
+         struct rebind { typedef pool_allocator<U, Tag> other; };
+
+         pool_allocator() {}
+         template<typename U>
+         pool_allocator( const pool_allocator<U, Tag>& ) {}
+
+         T* allocate( size_t n )
+         {
+            if( n == 1 )
+               return static_cast<T*>( node_pool<Tag>::instance().allocate( sizeof(T), alignof(T) ) );
+            return static_cast<T*>( ::operator new( n * sizeof(T) ) );
+         }
+         void deallocate( T* p, size_t n )
+         {
+            if( n == 1 )
+               node_pool<Tag>::instance().deallocate( p, sizeof(T), alignof(T) );
+            else
+               ::operator delete( p );
+         }
+
+         template<typename U, typename... Args>
+         void construct( U* p, Args&&... args ) { new( (void*)p ) U( std::forward<Args>(args)... ); }
+         template<typename U>
+         void destroy( U* p ) { p->~U(); }
+
+         size_t max_size()const { return size_t(-1) / sizeof(T); }
+
+         friend bool operator==( const pool_allocator&, const pool_allocator& ) { return true;  }
+         friend bool operator!=( const pool_allocator&, const pool_allocator& ) { return false; }
+   };
+
+   /** Occupancy of the pool behind an allocator, empty for allocators which do not pool. */
+   template<typename Allocator>
+   fc::optional<node_pool_stats> get_pool_stats( const Allocator& ) { return fc::optional<node_pool_stats>(); }
+   template<typename T, typename Tag>
+   fc::optional<node_pool_stats> get_pool_stats( const pool_allocator<T, Tag>& )
+   {
+      return node_pool<Tag>::instance().stats();
+   }
+
+   /** Identifies the pool behind an allocator, null for allocators which do not pool. */
+   template<typename Allocator>
+   const void* get_pool_id( const Allocator& ) { return nullptr; }
+   template<typename T, typename Tag>
+   const void* get_pool_id( const pool_allocator<T, Tag>& ) { return &node_pool<Tag>::instance(); }
+
+} } // graphene::db
+
+FC_REFLECT( graphene::db::node_pool_stats, (slot_size)(chunks)(capacity)(in_use)(allocations)(fallbacks) )
@@ -24,6 +24,8 @@
 #include <fc/crypto/city.hpp>
 #include <fc/uint128.hpp>
 
+#include <new>
+
 namespace graphene { namespace db {
 
    /**
@@ -69,9 +71,15 @@ namespace graphene { namespace db {
 
          /// these methods are implemented for derived classes by inheriting abstract_object<DerivedClass>
          virtual unique_ptr<object> clone()const = 0;
+         /// copy constructs the most derived type in storage of at least storage_size() bytes aligned to storage_alignment()
+         virtual object*            clone_into( void* storage )const = 0;
+         virtual size_t             storage_size()const = 0;
+         virtual size_t             storage_alignment()const = 0;
          virtual void               move_from( object& obj ) = 0;
          virtual variant            to_variant()const  = 0;
          virtual vector<char>       pack()const = 0;
+         /// replaces the value of this object with data produced by pack()
+         virtual void               unpack_from( const vector<char>& data ) = 0;
          virtual fc::uint128        hash()const = 0;
    };
 
@@ -91,12 +99,25 @@ namespace graphene { namespace db {
             return unique_ptr<object>(new DerivedClass( *static_cast<const DerivedClass*>(this) ));
          }
 
+         virtual object* clone_into( void* storage )const
+         {
+            return new (storage) DerivedClass( *static_cast<const DerivedClass*>(this) );
+         }
+         virtual size_t storage_size()const      { return sizeof(DerivedClass); }
+         virtual size_t storage_alignment()const { return alignof(DerivedClass); }
+
          virtual void    move_from( object& obj )
          {
             static_cast<DerivedClass&>(*this) = std::move( static_cast<DerivedClass&>(obj) );
          }
          virtual variant to_variant()const { return variant( static_cast<const DerivedClass&>(*this) ); }
          virtual vector<char> pack()const  { return fc::raw::pack( static_cast<const DerivedClass&>(*this) ); }
+         virtual void unpack_from( const vector<char>& data )
+         {
+            DerivedClass tmp;
+            fc::raw::unpack( data, tmp );
+            static_cast<DerivedClass&>(*this) = std::move( tmp );
+         }
          virtual fc::uint128  hash()const  {  
              auto tmp = this->pack();
              return fc::city_hash_crc_128( tmp.data(), tmp.size() );
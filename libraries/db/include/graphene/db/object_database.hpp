@@ -22,6 +22,7 @@
 #include <graphene/db/object.hpp>
 #include <graphene/db/index.hpp>
 #include <graphene/db/undo_database.hpp>
+#include <graphene/db/change_journal.hpp>
 
 #include <fc/log/logger.hpp>
 
@@ -29,6 +30,14 @@
 
 namespace graphene { namespace db {
 
+   /** node pool occupancy of the index of space_id.type_id */
+   struct index_pool_stats
+   {
+      uint8_t          space_id = 0;
+      uint8_t          type_id  = 0;
+      node_pool_stats  pool;
+   };
+
    /**
     *   @class object_database
     *   @brief maintains a set of indexed objects that can be modified with multi-level rollback support
@@ -47,6 +56,48 @@ namespace graphene { namespace db {
           * Saves the complete state of the object_database to disk, this could take a while
           */
          void flush();
+         /**
+          * Saves only the objects which changed since the last flush or checkpoint, the cost is proportional
+          * to the amount of change rather than to the size of the state.
+          */
+         void checkpoint();
+
+         /**
+          * Journals committed changes to data_dir/object_database/journal so that the state can be recovered
+          * after an unclean shutdown by loading the last checkpoint and rolling the journal forward.  Must be
+          * called before open().
+          *
+          * @param sync_interval fsync the journal every sync_interval commits, 0 leaves flushing to the OS
+          */
+         void enable_journal( uint32_t sync_interval = 1 );
+         bool journal_enabled()const { return _journal_enabled; }
+
+         /**
+          * Appends every object changed since the previous commit as one journal record, this should only be
+          * called when the state is consistent, i.e. not in the middle of applying a block.
+          */
+         void commit_journal();
+
+         /**
+          * Maintains an order independent digest of every index marked with mark_state_digest_indexes(), updated
+          * incrementally as objects are added, modified and removed.  Two nodes with the same state report the
+          * same digest no matter how they arrived at it.  Must be called before open().
+          */
+         void enable_state_digest() { _state_digest_enabled = true; }
+         bool state_digest_enabled()const { return _state_digest_enabled; }
+
+         /** Seeds the digest of every marked index from a full index::hash(), called once the state is loaded */
+         void reset_state_digest();
+
+         /** @return the combined digest of the marked indexes, zero unless enabled and seeded */
+         fc::uint128 state_digest()const;
+
+         /**
+          * @return the node pool occupancy of every index which allocates from a node_pool.  Pools are shared by
+          * every index with the same Tag in the process, so the figures include the indexes of other databases.
+          */
+         vector<index_pool_stats> get_index_pool_stats()const;
+
          void wipe(const fc::path& data_dir); // remove from disk
          void close();
 
@@ -83,9 +134,13 @@ namespace graphene { namespace db {
 
          const object& insert( object&& obj ) { return get_mutable_index(obj.id).insert( std::move(obj) ); }
          void          remove( const object& obj ) { get_mutable_index(obj.id).remove( obj ); }
+         /**
+          * Objects whose index is declared with GRAPHENE_DB_TYPED_INDEX are modified through the concrete
+          * primary_index with the modifier inlined, everything else goes through the virtual index interface.
+          */
          template<typename T, typename Lambda>
          void modify( const T& obj, const Lambda& m ) {
-            get_mutable_index(obj.id).modify(obj,m);
+            modify_impl( obj, m, std::is_void<typename typed_index<T>::type>() );
          }
 
          ///@}
@@ -128,6 +183,9 @@ namespace graphene { namespace db {
          IndexType* add_index()
          {
             typedef typename IndexType::object_type ObjectType;
+            static_assert( std::is_void<typename typed_index<ObjectType>::type>::value ||
+                           std::is_same<typename typed_index<ObjectType>::type, IndexType>::value,
+                           "Index type does not match the one declared with GRAPHENE_DB_TYPED_INDEX" );
             if( _index[ObjectType::space_id].size() <= ObjectType::type_id  )
                 _index[ObjectType::space_id].resize( 255 );
             assert(!_index[ObjectType::space_id][ObjectType::type_id]);
@@ -153,18 +211,42 @@ namespace graphene { namespace db {
          index& get_mutable_index(object_id_type id)  { return get_mutable_index(id.space(),id.type());   }
          index& get_mutable_index(uint8_t space_id, uint8_t type_id);
 
+         /** Marks every index registered so far as part of state_digest(), indexes added later are left out */
+         void mark_state_digest_indexes();
+
      private:
+         template<typename T, typename Lambda>
+         void modify_impl( const T& obj, const Lambda& m, std::true_type /* untyped */ ) {
+            get_mutable_index(obj.id).modify(obj,m);
+         }
+         template<typename T, typename Lambda>
+         void modify_impl( const T& obj, const Lambda& m, std::false_type /* typed */ ) {
+            typedef typename typed_index<T>::type index_type;
+            index& idx = get_mutable_index( T::space_id, T::type_id );
+            assert( nullptr != dynamic_cast<index_type*>( &idx ) );
+            static_cast<index_type&>( idx ).modify_typed( obj, m );
+         }
 
          friend class base_primary_index;
          friend class undo_database;
          void save_undo( const object& obj );
          void save_undo_add( const object& obj );
          void save_undo_remove( const object& obj );
+         void journal_change( object_id_type id ) { if( _journal.is_open() ) _journal_changes.insert( id ); }
+
+         fc::path get_journal_path()const { return _data_dir / "object_database" / "journal"; }
 
          fc::path                                                  _data_dir;
+         bool                                                      _journal_enabled = false;
+         bool                                                      _state_digest_enabled = false;
+         uint32_t                                                  _journal_sync_interval = 1;
+         change_journal                                            _journal;
+         std::unordered_set<object_id_type>                        _journal_changes;
          vector< vector< unique_ptr<index> > >                     _index;
    };
 
 } } // graphene::db
 
+FC_REFLECT( graphene::db::index_pool_stats, (space_id)(type_id)(pool) )
+
 
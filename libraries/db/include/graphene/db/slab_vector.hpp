@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#pragma once
+#include <bitset>
+#include <cassert>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /**
+    *  @class slab_vector
+    *  @brief Sparse array of T stored in fixed size chunks
+    *
+    *  Elements are constructed in place inside chunks of 2^ChunkBits slots, so growing the array never
+    *  moves an element and references stay valid until the element is erased.  Access by position is
+    *  a shift and a mask, iteration walks the chunks in order and skips empty slots.
+    */
+   template<typename T, unsigned ChunkBits = 8>
+   class slab_vector
+   {
+         static const size_t chunk_size = size_t(1) << ChunkBits;
+         static const size_t chunk_mask = chunk_size - 1;
+
+         struct chunk
+         {
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type slots[chunk_size];
+            std::bitset<chunk_size>                                     live;
+
+            T*       at( size_t i )       { return reinterpret_cast<T*>( &slots[i] ); }
+            const T* at( size_t i )const  { return reinterpret_cast<const T*>( &slots[i] ); }
+         };
+
+      public:
+         slab_vector() {}
+         slab_vector( const slab_vector& ) = delete;
+         slab_vector& operator=( const slab_vector& ) = delete;
+         ~slab_vector() { clear(); }
+
+         /** @return the element at pos or nullptr if the slot is empty */
+         T* find( size_t pos )
+         {
+            if( pos >= _size ) return nullptr;
+            chunk* c = _chunks[pos >> ChunkBits].get();
+            return ( c != nullptr && c->live[pos & chunk_mask] ) ? c->at( pos & chunk_mask ) : nullptr;
+         }
+         const T* find( size_t pos )const { return const_cast<slab_vector*>(this)->find( pos ); }
+
+         /** Constructs an element in the empty slot pos */
+         template<typename... Args>
+         T& emplace( size_t pos, Args&&... args )
+         {
+            const size_t c = pos >> ChunkBits;
+            if( c >= _chunks.size() ) _chunks.resize( c + 1 );
+            if( !_chunks[c] ) _chunks[c].reset( new chunk );
+            chunk& ch = *_chunks[c];
+            assert( !ch.live[pos & chunk_mask] );
+            T* result = new( ch.at( pos & chunk_mask ) ) T( std::forward<Args>(args)... );
+            ch.live.set( pos & chunk_mask );
+            if( pos >= _size ) _size = pos + 1;
+            return *result;
+         }
+
+         /** Destroys the element at pos, chunks left without elements are released */
+         void erase( size_t pos )
+         {
+            chunk* ch = pos < _size ? _chunks[pos >> ChunkBits].get() : nullptr;
+            if( ch == nullptr || !ch->live[pos & chunk_mask] ) return;
+            ch->at( pos & chunk_mask )->~T();
+            ch->live.reset( pos & chunk_mask );
+            if( ch->live.none() ) _chunks[pos >> ChunkBits].reset();
+            if( pos + 1 == _size ) shrink_size();
+         }
+
+         void clear()
+         {
+            for( auto& ch : _chunks )
+            {
+               if( !ch ) continue;
+               for( size_t i = 0; i < chunk_size; ++i )
+                  if( ch->live[i] ) ch->at(i)->~T();
+            }
+            _chunks.clear();
+            _size = 0;
+         }
+
+         /** @return one past the highest occupied position */
+         size_t size()const { return _size; }
+         void   reserve( size_t n ) { _chunks.reserve( (n + chunk_mask) >> ChunkBits ); }
+
+         template<typename Visitor>
+         void for_each( Visitor&& v )const
+         {
+            for( const auto& ch : _chunks )
+            {
+               if( !ch ) continue;
+               for( size_t i = 0; i < chunk_size; ++i )
+                  if( ch->live[i] ) v( *ch->at(i) );
+            }
+         }
+
+         class const_iterator
+         {
+            public:
+               typedef std::forward_iterator_tag iterator_category;
+               typedef T                         value_type;
+               typedef std::ptrdiff_t            difference_type;
+               typedef const T*                  pointer;
+               typedef const T&                  reference;
+
+               const_iterator( const slab_vector* s = nullptr, size_t pos = 0 ):_slab(s),_pos(pos) { skip_empty(); }
+
+               friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._pos == b._pos; }
+               friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._pos != b._pos; }
+               const T& operator*()const  { return *_slab->find( _pos ); }
+               const T* operator->()const { return _slab->find( _pos ); }
+               const_iterator& operator++()    { ++_pos; skip_empty(); return *this; }
+               const_iterator  operator++(int) { const_iterator r( *this ); ++(*this); return r; }
+               size_t position()const { return _pos; }
+
+            private:
+               void skip_empty()
+               {
+                  if( _slab == nullptr ) return;
+                  while( _pos < _slab->_size )
+                  {
+                     const chunk* ch = _slab->_chunks[_pos >> ChunkBits].get();
+                     if( ch == nullptr )
+                        _pos = (_pos | chunk_mask) + 1;
+                     else if( !ch->live[_pos & chunk_mask] )
+                        ++_pos;
+                     else
+                        return;
+                  }
+                  _pos = _slab->_size;
+               }
+
+               const slab_vector* _slab;
+               size_t             _pos;
+         };
+
+         const_iterator begin()const { return const_iterator( this, 0 ); }
+         const_iterator end()const   { return const_iterator( this, _size ); }
+
+      private:
+         void shrink_size()
+         {
+            while( _size > 0 )
+            {
+               const chunk* ch = _chunks[(_size - 1) >> ChunkBits].get();
+               if( ch != nullptr && ch->live[(_size - 1) & chunk_mask] ) break;
+               if( ch == nullptr ) _size = (_size - 1) & ~chunk_mask; else --_size;
+            }
+            _chunks.resize( (_size + chunk_mask) >> ChunkBits );
+         }
+
+         std::vector< std::unique_ptr<chunk> > _chunks;
+         size_t                                _size = 0;
+   };
+
+} } // graphene::db
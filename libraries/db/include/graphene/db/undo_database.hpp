@@ -20,6 +20,7 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <algorithm>
 #include <deque>
 #include <fc/exception/exception.hpp>
 
@@ -29,12 +30,187 @@ namespace graphene { namespace db {
    using fc::flat_set;
    class object_database;
 
+   /**
+    *  @class undo_arena
+    *  @brief bump allocator holding the before-images of one undo state
+    *
+    *  Objects are copy constructed into blocks of increasing size instead of being cloned
+    *  onto the heap one by one, and all of them are destroyed and released at once with
+    *  the arena.
+    */
+   class undo_arena
+   {
+      public:
+         undo_arena(){}
+         undo_arena( undo_arena&& other );
+         undo_arena( const undo_arena& ) = delete;
+         undo_arena& operator = ( const undo_arena& ) = delete;
+         ~undo_arena() { clear(); }
+
+         /** @return a copy of obj owned by this arena */
+         object* copy( const object& obj );
+
+         /** takes ownership of every object and block of other */
+         void splice( undo_arena& other );
+
+         void clear();
+
+      private:
+         struct block
+         {
+            unique_ptr<char[]> data;
+            size_t             size = 0;
+            size_t             used = 0;
+         };
+
+         vector<block>   _blocks;
+         vector<object*> _objects;
+   };
+
+   /**
+    *  @class flat_id_map
+    *  @brief open addressed map from object id to V
+    *
+    *  Entries live in a single vector in insertion order and the hash table only stores
+    *  their positions, so no node is allocated per touched object.  Erasing moves the
+    *  last entry into the hole, iterators are invalidated by emplace and erase.
+    */
+   template<typename V>
+   class flat_id_map
+   {
+      public:
+         typedef std::pair<object_id_type,V>                  value_type;
+         typedef typename vector<value_type>::iterator        iterator;
+         typedef typename vector<value_type>::const_iterator  const_iterator;
+
+         iterator       begin()       { return _entries.begin(); }
+         iterator       end()         { return _entries.end();   }
+         const_iterator begin()const  { return _entries.begin(); }
+         const_iterator end()const    { return _entries.end();   }
+         size_t         size()const   { return _entries.size();  }
+         bool           empty()const  { return _entries.empty(); }
+
+         iterator find( object_id_type id )
+         {
+            auto s = locate( id );
+            return s == npos ? end() : begin() + _slots[s];
+         }
+         const_iterator find( object_id_type id )const
+         {
+            auto s = locate( id );
+            return s == npos ? end() : begin() + _slots[s];
+         }
+         size_t count( object_id_type id )const { return locate( id ) != npos; }
+
+         /** inserts value unless id is already present, like std::map::emplace */
+         std::pair<iterator,bool> emplace( object_id_type id, V value )
+         {
+            auto s = locate( id );
+            if( s != npos )
+               return std::make_pair( begin() + _slots[s], false );
+            if( (_entries.size() + 1) * 2 > _slots.size() )
+               rehash( std::max<size_t>( 16, _slots.size() * 2 ) );
+            for( s = slot_for( id ); _slots[s] != empty_slot; s = (s + 1) & mask() ) {}
+            _slots[s] = _entries.size();
+            _entries.emplace_back( id, std::move(value) );
+            return std::make_pair( end() - 1, true );
+         }
+
+         void erase( object_id_type id )
+         {
+            auto s = locate( id );
+            if( s == npos ) return;
+            const uint32_t pos = _slots[s];
+            remove_slot( s );
+            const uint32_t last = _entries.size() - 1;
+            if( pos != last )
+            {
+               _slots[ locate( _entries[last].first ) ] = pos;
+               _entries[pos] = std::move( _entries[last] );
+            }
+            _entries.pop_back();
+         }
+
+         void clear() { _entries.clear(); _slots.clear(); }
+
+      private:
+         static const uint32_t empty_slot = uint32_t(-1);
+         static const size_t   npos = size_t(-1);
+
+         size_t mask()const { return _slots.size() - 1; }
+         size_t slot_for( object_id_type id )const
+         {
+            uint64_t h = id.number * 0x9E3779B97F4A7C15ull;
+            return size_t( h ^ (h >> 32) ) & mask();
+         }
+
+         size_t locate( object_id_type id )const
+         {
+            if( _slots.empty() ) return npos;
+            for( size_t s = slot_for( id ); _slots[s] != empty_slot; s = (s + 1) & mask() )
+               if( _entries[_slots[s]].first == id )
+                  return s;
+            return npos;
+         }
+
+         /** backward shift deletion, keeps every probe sequence intact without tombstones */
+         void remove_slot( size_t hole )
+         {
+            for( size_t s = (hole + 1) & mask(); _slots[s] != empty_slot; s = (s + 1) & mask() )
+            {
+               size_t ideal = slot_for( _entries[_slots[s]].first );
+               if( ((s - ideal) & mask()) >= ((s - hole) & mask()) )
+               {
+                  _slots[hole] = _slots[s];
+                  hole = s;
+               }
+            }
+            _slots[hole] = empty_slot;
+         }
+
+         void rehash( size_t slot_count )
+         {
+            _slots.assign( slot_count, empty_slot );
+            for( uint32_t i = 0; i < _entries.size(); ++i )
+            {
+               size_t s = slot_for( _entries[i].first );
+               while( _slots[s] != empty_slot ) s = (s + 1) & mask();
+               _slots[s] = i;
+            }
+         }
+
+         vector<value_type> _entries;
+         vector<uint32_t>   _slots;
+   };
+
+   /**
+    *  Before-image of a modified object in packed form.  Once its state is committed and the
+    *  after value is known, it is reduced to the bytes between the prefix and suffix it shares
+    *  with the packed after value.
+    */
+   struct packed_undo_value
+   {
+      packed_undo_value(){}
+      explicit packed_undo_value( vector<char>&& before ):data( std::move(before) ){}
+
+      vector<char> data;
+      uint32_t     prefix = 0;
+      uint32_t     suffix = 0;
+      bool         delta = false;
+   };
+
+   /**
+    *  The before-images in old_values and removed are owned by arena.  With delta encoding
+    *  enabled modified objects are saved in packed_old_values instead of old_values.
+    */
    struct undo_state
    {
-      unordered_map<object_id_type, unique_ptr<object> > old_values;
-      unordered_map<object_id_type, object_id_type>      old_index_next_ids;
-      std::unordered_set<object_id_type>                 new_ids;
-      unordered_map<object_id_type, unique_ptr<object> > removed;
+      flat_id_map<object*>            old_values;
+      flat_id_map<packed_undo_value>  packed_old_values;
+      flat_id_map<object_id_type>     old_index_next_ids;
+      flat_id_map<bool>               new_ids;
+      flat_id_map<object*>            removed;
+      undo_arena                      arena;
    };
 
 
@@ -92,6 +268,14 @@ namespace graphene { namespace db {
          void    enable();
          bool    enabled()const { return !_disabled; }
 
+         /**
+          * Save modified objects as packed before-images, reduced to a diff against the committed value
+          * on commit.  This trades the cost of packing on modify and commit for much less undo memory
+          * when large objects change slightly.
+          */
+         void    set_delta_encoding( bool enabled ) { _delta_encoding = enabled; }
+         bool    delta_encoding()const { return _delta_encoding; }
+
          session start_undo_session( bool force_enable = false );
          /**
           * This should be called just after an object is created
@@ -134,8 +318,12 @@ namespace graphene { namespace db {
          void merge();
          void commit();
 
+         /** reverts every object in state.packed_old_values to its before-image */
+         void restore_packed_values( undo_state& state );
+
          uint32_t                _active_sessions = 0;
          bool                    _disabled = true;
+         bool                    _delta_encoding = false;
          std::deque<undo_state>  _stack;
          object_database&        _db;
          size_t                  _max_size = 256;
@@ -24,17 +24,25 @@
 
 namespace graphene { namespace db {
    void base_primary_index::save_undo( const object& obj )
-   { _db.save_undo( obj ); }
+   { _db.save_undo( obj ); digest_remove( obj ); }
 
    void base_primary_index::on_add( const object& obj )
    {
       _db.save_undo_add( obj );
+      mark_dirty( obj );
+      digest_add( obj );
       for( auto ob : _observers ) ob->on_add( obj );
    }
 
    void base_primary_index::on_remove( const object& obj )
-   { _db.save_undo_remove( obj ); for( auto ob : _observers ) ob->on_remove( obj ); }
+   { _db.save_undo_remove( obj ); mark_dirty( obj ); digest_remove( obj ); for( auto ob : _observers ) ob->on_remove( obj ); }
 
    void base_primary_index::on_modify( const object& obj )
-   {for( auto ob : _observers ) ob->on_modify(  obj ); }
+   { mark_dirty( obj ); digest_add( obj ); for( auto ob : _observers ) ob->on_modify(  obj ); }
+
+   void base_primary_index::mark_dirty( const object& obj )
+   {
+      _dirty.insert( obj.id );
+      _db.journal_change( obj.id );
+   }
 } } // graphene::chain
@@ -19,10 +19,15 @@
  *
  */
 #include <graphene/db/object_database.hpp>
+#include <graphene/db/durable_file.hpp>
 
 #include <fc/io/raw.hpp>
 #include <fc/container/flat.hpp>
 #include <fc/uint128.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <atomic>
+#include <thread>
 
 namespace graphene { namespace db {
 
@@ -37,6 +42,8 @@ object_database::~object_database(){}
 
 void object_database::close()
 {
+   _journal.close();
+   _journal_changes.clear();
 }
 
 const object* object_database::find_object( object_id_type id )const
@@ -78,6 +85,117 @@ void object_database::flush()
    }
 }
 
+void object_database::checkpoint()
+{
+   for( uint32_t space = 0; space < _index.size(); ++space )
+   {
+      fc::create_directories( _data_dir / "object_database" / fc::to_string(space) );
+      const auto types = _index[space].size();
+      for( uint32_t type = 0; type  <  types; ++type )
+         if( _index[space][type] )
+            _index[space][type]->checkpoint( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+   }
+
+   // everything in the journal is now covered by the checkpoint, once the files it created are durable
+   if( _journal.is_open() )
+   {
+      for( uint32_t space = 0; space < _index.size(); ++space )
+         sync_directory( _data_dir / "object_database" / fc::to_string(space) );
+      sync_directory( _data_dir / "object_database" );
+      sync_directory( _data_dir );
+      _journal_changes.clear();
+      _journal.reset();
+   }
+}
+
+void object_database::enable_journal( uint32_t sync_interval )
+{
+   _journal_enabled = true;
+   _journal_sync_interval = sync_interval;
+}
+
+void object_database::commit_journal()
+{ try {
+   if( !_journal.is_open() || _journal_changes.empty() ) return;
+
+   journal_record rec;
+   rec.objects.reserve( _journal_changes.size() );
+   flat_set<uint16_t> changed_indexes;
+   for( const auto& id : _journal_changes )
+   {
+      object_delta item;
+      item.id = id;
+      const object* obj = find_object( id );
+      if( obj != nullptr && obj->id == id )
+         item.data = obj->pack();
+      rec.objects.emplace_back( std::move(item) );
+      changed_indexes.insert( id.space_type() );
+   }
+   for( auto space_type : changed_indexes )
+      rec.next_ids.push_back( get_index( space_type >> 8, space_type & 0xff ).get_next_id() );
+
+   _journal.append( rec );
+   _journal_changes.clear();
+} FC_CAPTURE_AND_RETHROW() }
+
+void object_database::mark_state_digest_indexes()
+{
+   for( auto& space : _index )
+      for( auto& idx : space )
+         if( idx )
+         {
+            auto* primary = dynamic_cast<base_primary_index*>( idx.get() );
+            if( primary != nullptr )
+               primary->set_in_state_digest( true );
+         }
+}
+
+void object_database::reset_state_digest()
+{
+   if( !_state_digest_enabled ) return;
+   for( auto& space : _index )
+      for( auto& idx : space )
+         if( idx )
+         {
+            auto* primary = dynamic_cast<base_primary_index*>( idx.get() );
+            if( primary != nullptr && primary->in_state_digest() )
+               primary->reset_digest( idx->hash() );
+         }
+}
+
+fc::uint128 object_database::state_digest()const
+{
+   fc::uint128 result;
+   for( const auto& space : _index )
+      for( const auto& idx : space )
+         if( idx )
+         {
+            const auto* primary = dynamic_cast<const base_primary_index*>( idx.get() );
+            if( primary != nullptr && primary->in_state_digest() && primary->digest_enabled() )
+               result += primary->digest();
+         }
+   return result;
+}
+
+vector<index_pool_stats> object_database::get_index_pool_stats()const
+{
+   vector<index_pool_stats> result;
+   for( const auto& space : _index )
+      for( const auto& idx : space )
+         if( idx )
+         {
+            auto pool = idx->pool_stats();
+            if( !pool.valid() )
+               continue;
+            index_pool_stats item;
+            item.space_id = idx->object_space_id();
+            item.type_id  = idx->object_type_id();
+            item.pool     = *pool;
+            result.push_back( item );
+         }
+   return result;
+}
+
 void object_database::wipe(const fc::path& data_dir)
 {
    close();
@@ -90,10 +208,76 @@ void object_database::open(const fc::path& data_dir)
 { try {
    ilog("Opening object database from ${d} ...", ("d", data_dir));
    _data_dir = data_dir;
+
+   vector<index*> indexes;
    for( uint32_t space = 0; space < _index.size(); ++space )
       for( uint32_t type = 0; type  < _index[space].size(); ++type )
          if( _index[space][type] )
-            _index[space][type]->open( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+            indexes.push_back( _index[space][type].get() );
+
+   // node pools are not synchronized, decoding indexes on different threads is only safe while no two of
+   // them allocate from the same pool, i.e. no two pooled indexes were declared with the same Tag
+   flat_set<const void*> pools;
+   for( const index* idx : indexes )
+      if( idx->pool_id() != nullptr )
+         FC_ASSERT( pools.insert( idx->pool_id() ).second, "Index ${s}.${t} shares its node pool with another index",
+                    ("s",idx->object_space_id())("t",idx->object_type_id()) );
+
+   // indexes are independent of each other, so they are decoded in parallel with each
+   // thread picking the next unopened index until all are done
+   vector<fc::microseconds> elapsed( indexes.size() );
+   std::atomic<size_t> next_index( 0 );
+   auto open_indexes = [&]()
+   {
+      for( size_t i = next_index++; i < indexes.size(); i = next_index++ )
+      {
+         auto start = fc::time_point::now();
+         const index& idx = *indexes[i];
+         indexes[i]->open( _data_dir / "object_database" / fc::to_string(idx.object_space_id())/fc::to_string(idx.object_type_id()) );
+         elapsed[i] = fc::time_point::now() - start;
+      }
+   };
+   const size_t thread_count = std::min<size_t>( std::max<size_t>( std::thread::hardware_concurrency(), 1 ), indexes.size() );
+   {
+      vector< unique_ptr<fc::thread> > threads;
+      vector< fc::future<void> >       done;
+      for( size_t i = 0; i < thread_count; ++i )
+      {
+         threads.emplace_back( new fc::thread( "object_database_open_" + fc::to_string(i) ) );
+         done.push_back( threads.back()->async( open_indexes, "open_indexes" ) );
+      }
+      // wait for every thread before rethrowing, they all refer to this frame
+      fc::optional<fc::exception> error;
+      for( auto& f : done )
+      {
+         try { f.wait(); }
+         catch( const fc::exception& e ) { if( !error ) error = e; }
+      }
+      if( error )
+         throw *error;
+   }
+
+   for( size_t i = 0; i < indexes.size(); ++i )
+      ilog( "Opened index ${s}.${t} in ${ms} ms",
+            ("s",indexes[i]->object_space_id())("t",indexes[i]->object_type_id())("ms",elapsed[i].count()/1000) );
+
+   if( _journal_enabled )
+   {
+      auto replayed = change_journal::replay( get_journal_path(), [&]( const journal_record& rec )
+      {
+         for( const auto& item : rec.objects )
+            get_mutable_index( item.id ).apply_delta( item );
+         for( const auto& next_id : rec.next_ids )
+            get_mutable_index( next_id.space(), next_id.type() ).set_next_id( next_id );
+      });
+      fc::create_directories( _data_dir / "object_database" );
+      _journal.open( get_journal_path(), _journal_sync_interval );
+      if( replayed > 0 )
+      {
+         ilog( "Rolled ${n} change journal records forward", ("n",replayed) );
+         checkpoint();
+      }
+   }
    ilog( "Done opening object database." );
 
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
@@ -24,6 +24,100 @@
 
 namespace graphene { namespace db {
 
+namespace {
+   /** reduces a full before-image to the bytes that differ from the packed after value */
+   void encode_delta( packed_undo_value& value, const vector<char>& after )
+   {
+      const auto& before = value.data;
+      const size_t common = std::min( before.size(), after.size() );
+      size_t prefix = 0;
+      while( prefix < common && before[prefix] == after[prefix] )
+         ++prefix;
+      size_t suffix = 0;
+      while( suffix < common - prefix && before[before.size()-1-suffix] == after[after.size()-1-suffix] )
+         ++suffix;
+      if( before.size() - prefix - suffix + 2*sizeof(uint32_t) >= before.size() )
+         return; // not worth it
+      value.data = vector<char>( before.begin() + prefix, before.end() - suffix );
+      value.prefix = prefix;
+      value.suffix = suffix;
+      value.delta = true;
+   }
+
+   /** @return the full before-image of value given the packed after value it was encoded against */
+   vector<char> before_image( const packed_undo_value& value, const vector<char>& after )
+   {
+      if( !value.delta )
+         return value.data;
+      FC_ASSERT( value.prefix + value.suffix <= after.size(), "Undo delta does not match the object it applies to" );
+      vector<char> before;
+      before.reserve( value.prefix + value.data.size() + value.suffix );
+      before.insert( before.end(), after.begin(), after.begin() + value.prefix );
+      before.insert( before.end(), value.data.begin(), value.data.end() );
+      before.insert( before.end(), after.end() - value.suffix, after.end() );
+      return before;
+   }
+
+   /** turns a delta back into a full before-image, needed before the after value changes */
+   void decode_delta( packed_undo_value& value, const vector<char>& after )
+   {
+      if( !value.delta ) return;
+      value.data = before_image( value, after );
+      value.prefix = value.suffix = 0;
+      value.delta = false;
+   }
+}
+
+undo_arena::undo_arena( undo_arena&& other )
+:_blocks( std::move(other._blocks) ),_objects( std::move(other._objects) )
+{
+   other._blocks.clear();
+   other._objects.clear();
+}
+
+object* undo_arena::copy( const object& obj )
+{
+   const size_t size  = obj.storage_size();
+   const size_t align = obj.storage_alignment();
+   auto fits = [&]( const block& b ) {
+      return ((b.used + align - 1) & ~(align - 1)) + size <= b.size;
+   };
+   if( _blocks.empty() || !fits( _blocks.back() ) )
+   {
+      // blocks grow with the state, so small sessions stay small and large ones rarely allocate
+      block b;
+      b.size = std::max( _blocks.empty() ? size_t(4096) : std::min( _blocks.back().size * 2, size_t(1024*1024) ),
+                         size + align );
+      b.data.reset( new char[b.size] );
+      _blocks.emplace_back( std::move(b) );
+   }
+   block& b = _blocks.back();
+   const size_t offset = (b.used + align - 1) & ~(align - 1);
+   object* result = obj.clone_into( b.data.get() + offset );
+   b.used = offset + size;
+   _objects.push_back( result );
+   return result;
+}
+
+void undo_arena::splice( undo_arena& other )
+{
+   if( other._blocks.empty() ) return;
+   _objects.insert( _objects.end(), other._objects.begin(), other._objects.end() );
+   // the last block stays last so that new copies keep filling it
+   _blocks.insert( _blocks.end() - (_blocks.empty() ? 0 : 1),
+                   std::make_move_iterator( other._blocks.begin() ), std::make_move_iterator( other._blocks.end() ) );
+   other._objects.clear();
+   other._blocks.clear();
+}
+
+void undo_arena::clear()
+{
+   for( object* obj : _objects )
+      obj->~object();
+   _objects.clear();
+   _blocks.clear();
+}
+
 void undo_database::enable()  { _disabled = false; }
 void undo_database::disable() { _disabled = true; }
 
@@ -49,10 +143,8 @@ void undo_database::on_create( const object& obj )
       _stack.emplace_back();
    auto& state = _stack.back();
    auto index_id = object_id_type( obj.id.space(), obj.id.type(), 0 );
-   auto itr = state.old_index_next_ids.find( index_id );
-   if( itr == state.old_index_next_ids.end() )
-      state.old_index_next_ids[index_id] = obj.id;
-   state.new_ids.insert(obj.id);
+   state.old_index_next_ids.emplace( index_id, obj.id );
+   state.new_ids.emplace( obj.id, true );
 }
 void undo_database::on_modify( const object& obj )
 {
@@ -61,11 +153,21 @@ void undo_database::on_modify( const object& obj )
    if( _stack.empty() )
       _stack.emplace_back();
    auto& state = _stack.back();
-   if( state.new_ids.find(obj.id) != state.new_ids.end() )
+   if( state.new_ids.count(obj.id) )
+      return;
+   if( state.old_values.count(obj.id) )
       return;
-   auto itr =  state.old_values.find(obj.id);
-   if( itr != state.old_values.end() ) return;
-   state.old_values[obj.id] = obj.clone();
+   auto packed = state.packed_old_values.find(obj.id);
+   if( packed != state.packed_old_values.end() )
+   {
+      // the state was committed since it saved obj, keep its delta valid for the value about to change
+      decode_delta( packed->second, obj.pack() );
+      return;
+   }
+   if( _delta_encoding )
+      state.packed_old_values.emplace( obj.id, packed_undo_value( obj.pack() ) );
+   else
+      state.old_values.emplace( obj.id, state.arena.copy( obj ) );
 }
 void undo_database::on_remove( const object& obj )
 {
@@ -79,14 +181,25 @@ void undo_database::on_remove( const object& obj )
       state.new_ids.erase(obj.id);
       return;
    }
-   if( state.old_values.count(obj.id) )
+   auto itr = state.old_values.find(obj.id);
+   if( itr != state.old_values.end() )
    {
-      state.removed[obj.id] = std::move(state.old_values[obj.id]);
+      object* old_value = itr->second;
       state.old_values.erase(obj.id);
+      state.removed.emplace( obj.id, old_value );
+      return;
+   }
+   auto packed = state.packed_old_values.find(obj.id);
+   if( packed != state.packed_old_values.end() )
+   {
+      object* old_value = state.arena.copy( obj );
+      old_value->unpack_from( before_image( packed->second, obj.pack() ) );
+      state.packed_old_values.erase(obj.id);
+      state.removed.emplace( obj.id, old_value );
       return;
    }
    if( state.removed.count(obj.id) ) return;
-   state.removed[obj.id] = obj.clone();
+   state.removed.emplace( obj.id, state.arena.copy( obj ) );
 }
 
 void undo_database::undo()
@@ -100,10 +213,11 @@ void undo_database::undo()
    {
       _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
    }
+   restore_packed_values( state );
 
    for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
    {
-      _db.remove( _db.get_object(*ritr) );
+      _db.remove( _db.get_object(ritr->first) );
    }
 
    for( auto& item : state.old_index_next_ids )
@@ -173,65 +287,93 @@ void undo_database::merge()
    // *+upd
    for( auto& obj : state.old_values )
    {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
+      if( prev_state.new_ids.count(obj.first) )
       {
          // new+upd -> new, type A
          continue;
       }
-      if( prev_state.old_values.find(obj.second->id) != prev_state.old_values.end() )
+      if( prev_state.old_values.count(obj.first) )
       {
          // upd(was=X) + upd(was=Y) -> upd(was=X), type A
          continue;
       }
+      auto packed = prev_state.packed_old_values.find(obj.first);
+      if( packed != prev_state.packed_old_values.end() )
+      {
+         // upd(was=X) + upd(was=Y) -> upd(was=X), type A, but a delta for X is relative to Y
+         decode_delta( packed->second, obj.second->pack() );
+         continue;
+      }
       // del+upd -> N/A
-      assert( prev_state.removed.find(obj.second->id) == prev_state.removed.end() );
+      assert( !prev_state.removed.count(obj.first) );
       // nop+upd(was=Y) -> upd(was=Y), type B
-      prev_state.old_values[obj.second->id] = std::move(obj.second);
+      prev_state.old_values.emplace( obj.first, obj.second );
    }
 
-   // *+new, but we assume the N/A cases don't happen, leaving type B nop+new -> new
-   for( auto id : state.new_ids )
-      prev_state.new_ids.insert(id);
-
-   // old_index_next_ids can only be updated, iterate over *+upd cases
-   for( auto& item : state.old_index_next_ids )
+   // the same for packed before-images
+   for( auto& item : state.packed_old_values )
    {
-      if( prev_state.old_index_next_ids.find( item.first ) == prev_state.old_index_next_ids.end() )
-      {
-         // nop+upd(was=Y) -> upd(was=Y), type B
-         prev_state.old_index_next_ids[item.first] = item.second;
+      if( item.second.delta )
+         decode_delta( item.second, _db.get_object( item.first ).pack() );
+      if( prev_state.new_ids.count(item.first) || prev_state.old_values.count(item.first) )
          continue;
-      }
-      else
+      auto packed = prev_state.packed_old_values.find(item.first);
+      if( packed != prev_state.packed_old_values.end() )
       {
-         // upd(was=X)+upd(was=Y) -> upd(was=X), type A
-         // type A implementation is a no-op, as discussed above, so there is no code here
+         decode_delta( packed->second, item.second.data );
          continue;
       }
+      assert( !prev_state.removed.count(item.first) );
+      prev_state.packed_old_values.emplace( item.first, std::move(item.second) );
+   }
+
+   // *+new, but we assume the N/A cases don't happen, leaving type B nop+new -> new
+   for( const auto& item : state.new_ids )
+      prev_state.new_ids.emplace( item.first, true );
+
+   // old_index_next_ids can only be updated, iterate over *+upd cases
+   for( auto& item : state.old_index_next_ids )
+   {
+      // nop+upd(was=Y) -> upd(was=Y), type B
+      // upd(was=X)+upd(was=Y) -> upd(was=X), type A, emplace() leaves the existing entry alone
+      prev_state.old_index_next_ids.emplace( item.first, item.second );
    }
 
    // *+del
    for( auto& obj : state.removed )
    {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
+      if( prev_state.new_ids.count(obj.first) )
       {
          // new + del -> nop (type C)
-         prev_state.new_ids.erase(obj.second->id);
+         prev_state.new_ids.erase(obj.first);
          continue;
       }
-      auto it = prev_state.old_values.find(obj.second->id);
+      auto it = prev_state.old_values.find(obj.first);
       if( it != prev_state.old_values.end() )
       {
          // upd(was=X) + del(was=Y) -> del(was=X)
-         prev_state.removed[obj.second->id] = std::move(it->second);
-         prev_state.old_values.erase(obj.second->id);
+         object* old_value = it->second;
+         prev_state.old_values.erase(obj.first);
+         prev_state.removed.emplace( obj.first, old_value );
+         continue;
+      }
+      auto packed = prev_state.packed_old_values.find(obj.first);
+      if( packed != prev_state.packed_old_values.end() )
+      {
+         // upd(was=X) + del(was=Y) -> del(was=X), with a delta for X relative to Y
+         obj.second->unpack_from( before_image( packed->second, obj.second->pack() ) );
+         prev_state.packed_old_values.erase(obj.first);
+         prev_state.removed.emplace( obj.first, obj.second );
          continue;
       }
       // del + del -> N/A
-      assert( prev_state.removed.find( obj.second->id ) == prev_state.removed.end() );
+      assert( !prev_state.removed.count(obj.first) );
       // nop + del(was=Y) -> del(was=Y)
-      prev_state.removed[obj.second->id] = std::move(obj.second);
+      prev_state.removed.emplace( obj.first, obj.second );
    }
+
+   // the before-images taken over from state live in its arena, release both together
+   prev_state.arena.splice( state.arena );
    _stack.pop_back();
    --_active_sessions;
 }
@@ -239,6 +381,22 @@ void undo_database::commit()
 {
    FC_ASSERT( _active_sessions > 0 );
    --_active_sessions;
+
+   // the after value of everything in the committed state is known now
+   if( !_stack.empty() )
+      for( auto& item : _stack.back().packed_old_values )
+         if( !item.second.delta )
+            encode_delta( item.second, _db.get_object( item.first ).pack() );
+}
+
+void undo_database::restore_packed_values( undo_state& state )
+{
+   for( auto& item : state.packed_old_values )
+   {
+      const object& current = _db.get_object( item.first );
+      auto before = before_image( item.second, current.pack() );
+      _db.modify( current, [&]( object& obj ){ obj.unpack_from( before ); } );
+   }
 }
 
 void undo_database::pop_commit()
@@ -254,10 +412,11 @@ void undo_database::pop_commit()
       {
          _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
       }
+      restore_packed_values( state );
 
       for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
       {
-         _db.remove( _db.get_object(*ritr) );
+         _db.remove( _db.get_object(ritr->first) );
       }
 
       for( auto& item : state.old_index_next_ids )
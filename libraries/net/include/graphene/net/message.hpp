@@ -69,6 +69,17 @@ namespace graphene { namespace net {
         size     = (uint32_t)data.size();
      }
 
+     /**
+      *  Wraps data which already is the serialized form of a message of type type, so that
+      *  stored messages can be sent without being unpacked and packed again.
+      */
+     message( uint32_t type, std::vector<char>&& packed )
+     :data( std::move(packed) )
+     {
+        msg_type = type;
+        size     = (uint32_t)data.size();
+     }
+
      fc::uint160_t id()const
      {
         return fc::ripemd160::hash( data.data(), (uint32_t)data.size() );
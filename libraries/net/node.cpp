@@ -2724,20 +2724,37 @@ namespace graphene { namespace net { namespace detail {
            ("type", fetch_items_message_received.item_type)
            ("endpoint", originating_peer->get_remote_endpoint()));
 
-      fc::optional<message> last_block_message_sent;
+      fc::optional<item_hash_t> last_block_id_sent;
 
-      std::list<message> reply_messages;
+      // replies are kept in request order, blocks are queued by id and only loaded, already serialized, when
+      // the peer's send queue reaches them
+      std::list<std::pair<item_id, fc::optional<message>>> replies;
       for (const item_hash_t& item_hash : fetch_items_message_received.items_to_fetch)
       {
+        item_id item_to_fetch(fetch_items_message_received.item_type, item_hash);
+        if (fetch_items_message_received.item_type == block_message_type)
+        {
+          if (_delegate->has_item(item_to_fetch))
+          {
+            replies.emplace_back(item_to_fetch, fc::optional<message>());
+            last_block_id_sent = item_hash;
+          }
+          else
+          {
+            replies.emplace_back(item_to_fetch, message(item_not_available_message(item_to_fetch)));
+            dlog("received block request from peer ${endpoint} but we don't have it",
+                 ("endpoint", originating_peer->get_remote_endpoint()));
+          }
+          continue;
+        }
+
         try
         {
           message requested_message = _message_cache.get_message(item_hash);
           dlog("received item request for item ${id} from peer ${endpoint}, returning the item from my message cache",
                ("endpoint", originating_peer->get_remote_endpoint())
                ("id", requested_message.id()));
-          reply_messages.push_back(requested_message);
-          if (fetch_items_message_received.item_type == block_message_type)
-            last_block_message_sent = requested_message;
+          replies.emplace_back(item_to_fetch, requested_message);
           continue;
         }
         catch (fc::key_not_found_exception&)
@@ -2745,7 +2762,6 @@ namespace graphene { namespace net { namespace detail {
            // it wasn't in our local cache, that's ok ask the client
         }
 
-        item_id item_to_fetch(fetch_items_message_received.item_type, item_hash);
         try
         {
           message requested_message = _delegate->get_item(item_to_fetch);
@@ -2753,33 +2769,30 @@ namespace graphene { namespace net { namespace detail {
                ("id", requested_message.id())
                ("size", requested_message.size)
                ("endpoint", originating_peer->get_remote_endpoint()));
-          reply_messages.push_back(requested_message);
-          if (fetch_items_message_received.item_type == block_message_type)
-            last_block_message_sent = requested_message;
+          replies.emplace_back(item_to_fetch, requested_message);
           continue;
         }
         catch (fc::key_not_found_exception&)
         {
-          reply_messages.push_back(item_not_available_message(item_to_fetch));
+          replies.emplace_back(item_to_fetch, message(item_not_available_message(item_to_fetch)));
           dlog("received item request from peer ${endpoint} but we don't have it",
                ("endpoint", originating_peer->get_remote_endpoint()));
         }
       }
 
       // if we sent them a block, update our record of the last block they've seen accordingly
-      if (last_block_message_sent)
+      if (last_block_id_sent)
       {
-        graphene::net::block_message block = last_block_message_sent->as<graphene::net::block_message>();
-        originating_peer->last_block_delegate_has_seen = block.block_id;
-        originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(block.block_id);
+        originating_peer->last_block_delegate_has_seen = *last_block_id_sent;
+        originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(*last_block_id_sent);
       }
 
-      for (const message& reply : reply_messages)
+      for (const auto& reply : replies)
       {
-        if (reply.msg_type == block_message_type)
-          originating_peer->send_item(item_id(block_message_type, reply.as<graphene::net::block_message>().block_id));
+        if (reply.second)
+          originating_peer->send_message(*reply.second);
         else
-          originating_peer->send_message(reply);
+          originating_peer->send_item(reply.first);
       }
     }
 
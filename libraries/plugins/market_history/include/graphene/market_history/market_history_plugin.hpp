@@ -109,7 +109,8 @@ typedef multi_index_container<
    indexed_by<
       hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
       ordered_unique< tag<by_key>, member< bucket_object, bucket_key, &bucket_object::key > >
-   >
+   >,
+   graphene::db::pool_allocator<bucket_object>
 > bucket_object_multi_index_type;
 
 typedef multi_index_container<
@@ -117,7 +118,8 @@ typedef multi_index_container<
    indexed_by<
       hashed_unique< tag<by_id>, member< object, object_id_type, &object::id > >,
       ordered_unique< tag<by_key>, member< order_history_object, history_key, &order_history_object::key > >
-   >
+   >,
+   graphene::db::pool_allocator<order_history_object>
 > order_history_multi_index_type;
 
 
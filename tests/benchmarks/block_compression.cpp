@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <graphene/chain/block_database.hpp>
+#include <graphene/utilities/tempdir.hpp>
+
+#include <fc/crypto/digest.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace graphene::chain;
+
+namespace {
+
+   /** signatures do not compress, fill them with hash output */
+   signature_type make_signature( const std::string& seed )
+   {
+      signature_type sig;
+      const auto h = fc::sha512::hash( seed );
+      std::memcpy( sig.data, h.data(), sizeof(h) );
+      sig.data[64] = 0x1f;
+      return sig;
+   }
+
+   /** the chain in GRAPHENE_BENCH_BLOCKS if it names a block database directory, blocks of similar transfers otherwise */
+   std::vector<signed_block> load_blocks()
+   {
+      std::vector<signed_block> blocks;
+      if( const char* dir = std::getenv( "GRAPHENE_BENCH_BLOCKS" ) )
+      {
+         block_database source;
+         source.open( fc::path( dir ) );
+         for( uint32_t i = 1; ; ++i )
+         {
+            auto b = source.fetch_by_number( i );
+            if( !b.valid() )
+               break;
+            blocks.push_back( std::move(*b) );
+         }
+         return blocks;
+      }
+
+      signed_block b;
+      for( uint32_t i = 0; i < 20000; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.timestamp = fc::time_point_sec( 1444000000 + 3 * i );
+         b.witness = witness_id_type( 1 + i % 11 );
+         b.transactions.clear();
+         for( uint32_t t = 0; t < i % 8; ++t )
+         {
+            transfer_operation op;
+            op.fee    = asset( 2000000 );
+            op.from   = account_id_type( 100 + (i * 7 + t) % 500 );
+            op.to     = account_id_type( 100 + (i * 13 + t) % 500 );
+            op.amount = asset( 1000 * (1 + (i + t) % 50), asset_id_type( (i + t) % 3 ) );
+            signed_transaction trx;
+            trx.ref_block_num    = uint16_t( i );
+            trx.ref_block_prefix = i * 2654435761u;
+            trx.expiration       = b.timestamp + 30;
+            trx.operations.push_back( op );
+            trx.signatures.push_back( make_signature( fc::to_string( i ) + "/" + fc::to_string( t ) ) );
+            b.transactions.push_back( trx );
+         }
+         b.witness_signature = make_signature( fc::to_string( i ) );
+         blocks.push_back( b );
+      }
+      return blocks;
+   }
+
+   uint64_t block_data_size( const fc::path& dir )
+   {
+      uint64_t size = 0;
+      for( fc::directory_iterator itr( dir ), end; itr != end; ++itr )
+      {
+         const std::string name = (*itr).filename().generic_string();
+         if( name.compare( 0, 7, "blocks-" ) == 0 || name.compare( 0, 7, "frames-" ) == 0 )
+            size += fc::file_size( *itr );
+      }
+      return size;
+   }
+
+}
+
+BOOST_AUTO_TEST_CASE( block_compression_bench )
+{
+   try {
+      const auto blocks = load_blocks();
+      const uint32_t count = blocks.size();
+      ilog( "Benchmarking ${n} blocks", ("n",count) );
+
+      uint64_t raw_size = 0;
+      for( bool compressed : { false, true } )
+      {
+         fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+         {
+            block_database bdb( 4096 );
+            bdb.set_compression( compressed );
+            bdb.open( data_dir.path() );
+            for( const auto& b : blocks )
+               bdb.store( b.id(), b );
+         } // close() waits for the compression of all but the last two segments
+
+         block_database bdb;
+         bdb.set_cache_size( 0 );
+         bdb.open( data_dir.path() );
+         auto start = fc::time_point::now();
+         for( uint32_t i = 1; i <= count; ++i )
+            BOOST_REQUIRE( bdb.fetch_by_number( i ).valid() );
+         const double in_order = double(count) * 1000000 / (fc::time_point::now() - start).count();
+
+         start = fc::time_point::now();
+         for( uint32_t i = 0; i < count; ++i )
+            BOOST_REQUIRE( bdb.fetch_by_number( 1 + uint64_t(i) * 7919 % count ).valid() );
+         const double at_random = double(count) * 1000000 / (fc::time_point::now() - start).count();
+
+         const uint64_t size = block_data_size( data_dir.path() );
+         if( !compressed )
+            raw_size = size;
+         else
+            BOOST_CHECK_LT( size, raw_size );
+         ilog( "${m}: ${s} bytes of block data, ${a} blocks/s in order, ${b} blocks/s at random",
+               ("m", compressed ? "compressed" : "uncompressed")("s",size)("a",in_order)("b",at_random) );
+      }
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
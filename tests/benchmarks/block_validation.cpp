@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Any modified source or binaries are used only with the BitShares network.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <graphene/chain/database.hpp>
+#include <graphene/chain/account_object.hpp>
+#include <graphene/utilities/tempdir.hpp>
+
+#include <fc/crypto/digest.hpp>
+#include <fc/smart_ref_impl.hpp>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <thread>
+
+#include "../common/database_fixture.hpp"
+
+using namespace graphene::chain;
+
+namespace {
+
+   const uint32_t account_count = 1500;
+
+   fc::ecc::private_key account_key( uint32_t i )
+   {
+      return fc::ecc::private_key::regenerate( fc::sha256::hash( "bench" + fc::to_string( i ) ) );
+   }
+
+   genesis_state_type make_bench_genesis()
+   {
+      genesis_state_type genesis_state;
+      genesis_state.initial_timestamp = time_point_sec( GRAPHENE_TESTING_GENESIS_TIMESTAMP );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string("null_key") ) );
+      genesis_state.initial_active_witnesses = 10;
+      for( uint32_t i = 0; i < genesis_state.initial_active_witnesses; ++i )
+      {
+         auto name = "init" + fc::to_string( i );
+         genesis_state.initial_accounts.emplace_back( name, init_account_priv_key.get_public_key(),
+                                                      init_account_priv_key.get_public_key(), true );
+         genesis_state.initial_committee_candidates.push_back( {name} );
+         genesis_state.initial_witness_candidates.push_back( {name, init_account_priv_key.get_public_key()} );
+      }
+      for( uint32_t i = 0; i < account_count; ++i )
+      {
+         const public_key_type key = account_key( i ).get_public_key();
+         genesis_state.initial_accounts.emplace_back( "bench" + fc::to_string( i ), key, key );
+      }
+      // account updates need no funds once the fees are zero
+      genesis_state.initial_parameters.current_fees->zero_all_fees();
+      return genesis_state;
+   }
+
+}
+
+/**
+ *  Pushes a block of one signed account update per account into fresh nodes which check all signatures, with the
+ *  stateless checks of its transactions spread over different numbers of worker threads.
+ */
+BOOST_AUTO_TEST_CASE( block_validation_bench )
+{
+   try {
+      const auto genesis_state = make_bench_genesis();
+      auto init_account_priv_key = fc::ecc::private_key::regenerate( fc::sha256::hash( string("null_key") ) );
+
+      signed_block block;
+      {
+         fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+         database db;
+         db.open( data_dir.path(), [&]{ return genesis_state; } );
+         const auto& accounts = db.get_index_type<account_index>().indices().get<by_name>();
+         for( uint32_t i = 0; i < account_count; ++i )
+         {
+            const account_object& account = *accounts.find( "bench" + fc::to_string( i ) );
+            account_update_operation op;
+            op.account = account.id;
+            op.new_options = account.options;
+            op.new_options->memo_key = account_key( ( i + 1 ) % account_count ).get_public_key();
+            signed_transaction trx;
+            set_expiration( db, trx );
+            trx.operations.push_back( op );
+            trx.sign( account_key( i ), db.get_chain_id() );
+            db.push_transaction( trx, database::skip_transaction_signatures );
+         }
+         block = db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key,
+                                    database::skip_transaction_signatures );
+         db.close();
+      }
+      BOOST_REQUIRE_EQUAL( block.transactions.size(), account_count );
+
+      const uint32_t cores = std::max( std::thread::hardware_concurrency(), 1u );
+      int64_t serial_us = 0;
+      for( uint32_t threads = 1; threads <= cores; threads *= 2 )
+      {
+         fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+         database db;
+         db.set_worker_threads( threads );
+         // a fresh node has not seen the transactions, its signature cache could only miss
+         db.set_signature_cache_size( 0 );
+         db.open( data_dir.path(), [&]{ return genesis_state; } );
+
+         const auto start = fc::time_point::now();
+         db.push_block( block, database::skip_nothing );
+         const int64_t us = ( fc::time_point::now() - start ).count();
+         if( threads == 1 )
+            serial_us = us;
+         BOOST_CHECK( db.head_block_id() == block.id() );
+         ilog( "${n} transactions with ${t} threads: ${ms} ms, ${x}x",
+               ("n",block.transactions.size())("t",threads)("ms",us / 1000)("x",double(serial_us) / us) );
+         db.close();
+      }
+   } catch(fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
@@ -48,6 +48,99 @@ BOOST_AUTO_TEST_CASE( sigcheck_benchmark )
    auto elapsed = end-start;
    wdump( ((100000.0*1000000.0) / elapsed.count()) );
 }
+BOOST_AUTO_TEST_CASE( undo_modify_benchmark )
+{
+   database db;
+   const uint32_t object_count = 10000;
+   vector<account_balance_id_type> ids;
+   for( uint32_t i = 0; i < object_count; ++i )
+      ids.push_back( db.create<account_balance_object>( [&]( account_balance_object& b ) {
+         b.owner = account_id_type(i);
+      }).id );
+
+   // one nested session per "transaction" modifying a few objects, merged into the "block" session
+   const uint32_t rounds = 100;
+   auto start = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+   {
+      auto block_session = db._undo_db.start_undo_session();
+      for( uint32_t i = 0; i < object_count; i += 4 )
+      {
+         auto trx_session = db._undo_db.start_undo_session();
+         for( uint32_t j = i; j < i + 4; ++j )
+            db.modify( ids[j](db), [&]( account_balance_object& b ) { b.balance += 1; } );
+         trx_session.merge();
+      }
+      block_session.undo();
+   }
+   auto elapsed = fc::time_point::now() - start;
+   ilog( "${ns} ns per modify", ("ns", double(elapsed.count()) * 1000 / (uint64_t(rounds) * object_count)) );
+}
+BOOST_AUTO_TEST_CASE( typed_modify_benchmark )
+{
+   database db;
+   const uint32_t object_count = 10000;
+   vector<const account_balance_object*> objects;
+   for( uint32_t i = 0; i < object_count; ++i )
+      objects.push_back( &db.create<account_balance_object>( [&]( account_balance_object& b ) {
+         b.owner = account_id_type(i);
+      }));
+
+   const uint32_t rounds = 100;
+   auto session = db._undo_db.start_undo_session();
+
+   // passing the object as graphene::db::object selects the virtual std::function path
+   auto start = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+      for( const auto* b : objects )
+         db.modify( static_cast<const object&>(*b), []( object& o ) {
+            static_cast<account_balance_object&>(o).balance += 1;
+         });
+   auto dynamic_elapsed = fc::time_point::now() - start;
+
+   start = fc::time_point::now();
+   for( uint32_t r = 0; r < rounds; ++r )
+      for( const auto* b : objects )
+         db.modify( *b, []( account_balance_object& o ) { o.balance += 1; } );
+   auto typed_elapsed = fc::time_point::now() - start;
+
+   for( const auto* b : objects )
+      BOOST_CHECK_EQUAL( b->balance.value, int64_t(2 * rounds) );
+
+   const double count = uint64_t(rounds) * object_count;
+   ilog( "dynamic: ${d} ns per modify, typed: ${t} ns per modify",
+         ("d", double(dynamic_elapsed.count()) * 1000 / count)("t", double(typed_elapsed.count()) * 1000 / count) );
+}
+BOOST_AUTO_TEST_CASE( dense_find_benchmark )
+{
+   database db;
+   primary_index< generic_index<account_balance_object, account_balance_object_multi_index_type, false> > tree_index( db );
+   primary_index< generic_index<account_balance_object, account_balance_object_multi_index_type, true> >  dense_index( db );
+   const uint32_t object_count = 100000;
+   for( uint32_t i = 0; i < object_count; ++i )
+   {
+      account_balance_object b;
+      b.id = account_balance_id_type(i);
+      b.owner = account_id_type(i);
+      account_balance_object c = b;
+      tree_index.insert( std::move(b) );
+      dense_index.insert( std::move(c) );
+   }
+
+   auto run = [&]( const index& idx ) {
+      uint64_t found = 0;
+      auto start = fc::time_point::now();
+      for( uint32_t r = 0; r < 10; ++r )
+         for( uint32_t i = 0; i < object_count; ++i )
+            found += idx.find( account_balance_id_type( (i * 7919) % object_count ) ) != nullptr;
+      BOOST_CHECK_EQUAL( found, uint64_t(10) * object_count );
+      return double( (fc::time_point::now() - start).count() ) * 1000 / (uint64_t(10) * object_count);
+   };
+   auto tree_ns = run( tree_index );
+   auto dense_ns = run( dense_index );
+   ilog( "tree: ${t} ns per find, dense: ${d} ns per find", ("t", tree_ns)("d", dense_ns) );
+}
+
 /*
 BOOST_AUTO_TEST_CASE( transfer_benchmark )
 {
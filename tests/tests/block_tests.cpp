@@ -21,8 +21,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <graphene/chain/block_prefetcher.hpp>
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/exceptions.hpp>
+#include <graphene/chain/worker_pool.hpp>
 
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
@@ -34,6 +36,11 @@
 
 #include <fc/crypto/digest.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
 #include "../common/database_fixture.hpp"
 
 using namespace graphene::chain;
@@ -90,7 +97,11 @@ BOOST_AUTO_TEST_CASE( block_database_test )
          fetch = bdb.fetch_optional( b.id() );
          FC_ASSERT( fetch.valid() );
          FC_ASSERT( fetch->witness ==  b.witness );
+         auto packed = bdb.fetch_packed( b.id() );
+         FC_ASSERT( packed.valid() );
+         FC_ASSERT( *packed == fc::raw::pack( b ) );
       }
+      FC_ASSERT( !bdb.fetch_packed( block_id_type() ).valid() );
 
       for( uint32_t i = 1; i < 5; ++i )
       {
@@ -122,6 +133,417 @@ BOOST_AUTO_TEST_CASE( block_database_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( block_database_concurrent_reads )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      block_database bdb;
+      bdb.open( data_dir.path() );
+
+      std::vector<block_id_type> ids;
+      signed_block b;
+      for( uint32_t i = 0; i < 100; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         bdb.store( b.id(), b );
+         ids.push_back( b.id() );
+      }
+
+      // ids are read from the mapped index while the writer keeps appending and growing it
+      std::atomic<bool> done( false );
+      std::atomic<uint32_t> mismatches( 0 );
+      std::thread reader( [&]() {
+         while( !done.load() )
+            for( uint32_t i = 1; i <= 100; ++i )
+               if( bdb.fetch_block_id( i ) != ids[i-1] || !bdb.contains( ids[i-1] ) )
+                  ++mismatches;
+      });
+      for( uint32_t i = 100; i < 70000; ++i )
+      {
+         b.previous = b.id();
+         bdb.store( b.id(), b );
+      }
+      done.store( true );
+      reader.join();
+      BOOST_CHECK_EQUAL( mismatches.load(), 0 );
+      BOOST_CHECK( *bdb.last_id() == b.id() );
+
+      bdb.remove( b.id() );
+      BOOST_CHECK( *bdb.last_id() == b.previous );
+      bdb.close();
+      bdb.open( data_dir.path() );
+      BOOST_CHECK( *bdb.last_id() == b.previous );
+      BOOST_CHECK( bdb.fetch_block_id( 1 ) == ids[0] );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_cache )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      block_database bdb;
+      bdb.open( data_dir.path() );
+
+      signed_block b;
+      std::vector<block_id_type> ids;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         ids.push_back( b.id() );
+      }
+      const auto packed_size = fc::raw::pack( b ).size();
+
+      // stored blocks are cached in both forms
+      auto stats = bdb.cache_stats();
+      BOOST_CHECK_EQUAL( stats.entries, 10u );
+      BOOST_CHECK_EQUAL( stats.size, 20 * packed_size );
+      BOOST_CHECK( bdb.fetch_by_number( 10 )->witness == witness_id_type(10) );
+      BOOST_CHECK( bdb.fetch_optional( ids[0] )->witness == witness_id_type(1) );
+      BOOST_CHECK( bdb.fetch_packed( ids[4] ).valid() );
+      stats = bdb.cache_stats();
+      BOOST_CHECK_EQUAL( stats.hits, 3u );
+      BOOST_CHECK_EQUAL( stats.misses, 0u );
+
+      // shrinking the cache evicts the least recently used blocks, 1 and 5 were read last
+      bdb.set_cache_size( 4 * packed_size );
+      stats = bdb.cache_stats();
+      BOOST_CHECK_EQUAL( stats.entries, 2u );
+      BOOST_CHECK( bdb.fetch_by_number( 5 )->witness == witness_id_type(5) );
+      BOOST_CHECK( bdb.fetch_by_number( 2 )->witness == witness_id_type(2) );
+      stats = bdb.cache_stats();
+      BOOST_CHECK_EQUAL( stats.hits, 4u );
+      BOOST_CHECK_EQUAL( stats.misses, 1u );
+      BOOST_CHECK_LE( stats.size, 4 * packed_size );
+
+      // removed and replaced blocks are never served from the cache
+      bdb.remove( ids[1] );
+      BOOST_CHECK( !bdb.fetch_by_number( 2 ).valid() );
+      b.previous = ids[0];
+      b.witness = witness_id_type(100);
+      bdb.store( b.id(), b );
+      BOOST_CHECK( bdb.fetch_by_number( 2 )->witness == witness_id_type(100) );
+      BOOST_CHECK( !bdb.fetch_optional( ids[1] ).valid() );
+
+      bdb.set_cache_size( 0 );
+      BOOST_CHECK_EQUAL( bdb.cache_stats().entries, 0u );
+      BOOST_CHECK( bdb.fetch_by_number( 3 )->witness == witness_id_type(3) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_segments )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      const fc::path segment0 = data_dir.path() / "blocks-0000000000";
+      std::vector<block_id_type> ids( 1 );
+      uint64_t live_size = 0;
+      {
+         block_database bdb( 16 );
+         bdb.open( data_dir.path() );
+
+         // store blocks 1-15 twice, the first copies are left behind in segment 0
+         signed_block b;
+         for( uint32_t round = 0; round < 2; ++round )
+         {
+            b = signed_block();
+            ids.resize( 1 );
+            for( uint32_t i = 1; i < 16; ++i )
+            {
+               if( i > 1 ) b.previous = b.id();
+               b.witness = witness_id_type( i + 100 * round );
+               bdb.store( b.id(), b );
+               ids.push_back( b.id() );
+               if( round == 1 )
+                  live_size += fc::raw::pack( b ).size() + block_database::record_header_size;
+            }
+         }
+         BOOST_CHECK_EQUAL( fc::file_size( segment0 ), 2 * live_size );
+
+         // starting segment 2 schedules the compaction of segment 0, close() waits for it
+         for( uint32_t i = 16; i < 100; ++i )
+         {
+            b.previous = b.id();
+            bdb.store( b.id(), b );
+            ids.push_back( b.id() );
+         }
+         BOOST_CHECK( fc::exists( data_dir.path() / "index-0000000096" ) );
+      }
+      BOOST_CHECK_EQUAL( fc::file_size( segment0 ), live_size );
+      BOOST_CHECK( !fc::exists( fc::path( segment0.generic_string() + ".compact" ) ) );
+
+      // the segment size on disk wins over the configured one
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      BOOST_CHECK_EQUAL( bdb.blocks_per_segment(), 16u );
+      for( uint32_t i = 1; i < 100; ++i )
+         BOOST_CHECK( bdb.fetch_by_number( i )->id() == ids[i] );
+      BOOST_CHECK( bdb.fetch_by_number( 7 )->witness == witness_id_type( 107 ) );
+
+      // pruning drops whole segments and never the last one
+      bdb.prune( 50 );
+      BOOST_CHECK_EQUAL( bdb.first_block_num(), 48u );
+      BOOST_CHECK( !bdb.fetch_by_number( 47 ).valid() );
+      BOOST_CHECK( !bdb.contains( ids[20] ) );
+      BOOST_CHECK( bdb.fetch_optional( ids[48] ).valid() );
+      bdb.prune( 1000 );
+      BOOST_CHECK_EQUAL( bdb.first_block_num(), 96u );
+      BOOST_CHECK( *bdb.last_id() == ids[99] );
+      bdb.close();
+      BOOST_CHECK( !fc::exists( segment0 ) );
+      BOOST_CHECK( !fc::exists( data_dir.path() / "index-0000000080" ) );
+
+      bdb.open( data_dir.path() );
+      BOOST_CHECK_EQUAL( bdb.first_block_num(), 96u );
+      BOOST_CHECK( bdb.fetch_by_number( 99 )->id() == ids[99] );
+      BOOST_CHECK( *bdb.last_id() == ids[99] );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_durability )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      const fc::path segment0 = data_dir.path() / "blocks-0000000000";
+      block_database bdb;
+      bdb.set_cache_size( 0 );
+      // nothing reaches the file before the interval, which never elapses here
+      bdb.set_durability( block_database::sync_interval, 3600 * 1000 );
+      bdb.open( data_dir.path() );
+
+      signed_block b;
+      uint64_t total = 0;
+      for( uint32_t i = 0; i < 10; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         bdb.store( b.id(), b );
+         total += fc::raw::pack( b ).size() + block_database::record_header_size;
+      }
+      BOOST_CHECK_EQUAL( fc::file_size( segment0 ), 0u );
+      // buffered blocks are read from memory
+      BOOST_CHECK( bdb.fetch_by_number( 10 )->id() == b.id() );
+      BOOST_CHECK( *bdb.fetch_packed( b.id() ) == fc::raw::pack( b ) );
+      BOOST_CHECK_EQUAL( bdb.store_stats().pending_bytes, total );
+
+      bdb.sync();
+      BOOST_CHECK_EQUAL( fc::file_size( segment0 ), total );
+      BOOST_CHECK_EQUAL( bdb.store_stats().pending_bytes, 0u );
+      BOOST_CHECK( bdb.fetch_by_number( 10 )->id() == b.id() );
+
+      // every store waits for its sync
+      bdb.set_durability( block_database::sync_every_block );
+      const auto syncs = bdb.store_stats().syncs;
+      for( uint32_t i = 0; i < 5; ++i )
+      {
+         b.previous = b.id();
+         bdb.store( b.id(), b );
+         total += fc::raw::pack( b ).size() + block_database::record_header_size;
+         BOOST_CHECK_EQUAL( fc::file_size( segment0 ), total );
+      }
+      auto stats = bdb.store_stats();
+      BOOST_CHECK_EQUAL( stats.blocks, 15u );
+      BOOST_CHECK_EQUAL( stats.syncs, syncs + 5 );
+      BOOST_CHECK_GE( stats.store_time_us, stats.max_store_time_us );
+
+      bdb.close();
+      bdb.open( data_dir.path() );
+      BOOST_CHECK( *bdb.last_id() == b.id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_tail_recovery )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      const fc::path blocks2 = data_dir.path() / "blocks-0000000032";
+      const fc::path index2  = data_dir.path() / "index-0000000032";
+      std::vector<block_id_type> ids( 1 );
+      {
+         block_database bdb( 16 );
+         bdb.open( data_dir.path() );
+         signed_block b;
+         for( uint32_t i = 1; i < 40; ++i )
+         {
+            if( i > 1 ) b.previous = b.id();
+            bdb.store( b.id(), b );
+            ids.push_back( b.id() );
+         }
+      }
+      auto block_pos = [&]( uint32_t num ) {
+         uint64_t pos = 0;
+         std::ifstream index( index2.generic_string().c_str(), std::ifstream::binary );
+         index.seekg( (num % 16) * 32 );
+         index.read( (char*)&pos, sizeof(pos) );
+         return pos;
+      };
+      // recovery clears the entries it drops
+      const uint64_t pos34 = block_pos( 34 ), pos35 = block_pos( 35 ), pos39 = block_pos( 39 );
+      block_database bdb( 16 );
+
+      // a torn last block
+      fc::resize_file( blocks2, fc::file_size( blocks2 ) - 3 );
+      bdb.open( data_dir.path() );
+      BOOST_CHECK( *bdb.last_id() == ids[38] );
+      BOOST_CHECK( !bdb.contains( ids[39] ) );
+      BOOST_CHECK_EQUAL( fc::file_size( blocks2 ), pos39 );
+      bdb.close();
+
+      // a block which does not match its checksum, everything above it goes as well
+      {
+         std::fstream blocks( blocks2.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+         blocks.seekg( pos35 + block_database::record_header_size + 4 );
+         const char c = blocks.get();
+         blocks.seekp( pos35 + block_database::record_header_size + 4 );
+         blocks.put( c ^ 0x55 );
+      }
+      bdb.open( data_dir.path() );
+      BOOST_CHECK( *bdb.last_id() == ids[34] );
+      BOOST_CHECK( !bdb.fetch_by_number( 36 ).valid() );
+      BOOST_CHECK_EQUAL( fc::file_size( blocks2 ), pos34 + fc::raw::pack( *bdb.last() ).size()
+                                                   + block_database::record_header_size );
+      bdb.close();
+
+      // an index entry which was lost leaves a gap in the previous segment
+      {
+         std::fstream index( (data_dir.path() / "index-0000000016").generic_string().c_str(),
+                             std::fstream::binary | std::fstream::in | std::fstream::out );
+         index.seekp( (20 % 16) * 32 );
+         const char zeros[32] = {};
+         index.write( zeros, sizeof(zeros) );
+      }
+      bdb.open( data_dir.path() );
+      BOOST_CHECK( *bdb.last_id() == ids[19] );
+      BOOST_CHECK( !bdb.fetch_by_number( 33 ).valid() );
+      for( uint32_t i = 1; i < 20; ++i )
+         BOOST_CHECK( bdb.fetch_by_number( i )->id() == ids[i] );
+
+      // the chain continues from the last intact block
+      signed_block b = *bdb.fetch_by_number( 19 );
+      for( uint32_t i = 20; i < 40; ++i )
+      {
+         b.previous = b.id();
+         bdb.store( b.id(), b );
+      }
+      bdb.close();
+      bdb.open( data_dir.path() );
+      BOOST_CHECK( *bdb.last_id() == b.id() );
+      BOOST_CHECK( bdb.fetch_by_number( 39 )->id() == b.id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_compression )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      std::vector<signed_block> blocks( 1 );
+      {
+         block_database bdb( 16 );
+         bdb.set_compression( true );
+         bdb.open( data_dir.path() );
+         signed_block b;
+         for( uint32_t i = 1; i < 60; ++i )
+         {
+            if( i > 1 ) b.previous = b.id();
+            b.transactions.clear();
+            for( uint32_t t = 0; t < 3; ++t )
+            {
+               transfer_operation op;
+               op.from = account_id_type( t );
+               op.to = account_id_type( i );
+               op.amount = asset( 1000 * i + t );
+               signed_transaction trx;
+               trx.operations.push_back( op );
+               b.transactions.push_back( trx );
+            }
+            bdb.store( b.id(), b );
+            blocks.push_back( b );
+         }
+      }
+      // segments 0 and 1 were compressed when segments 2 and 3 were started
+      BOOST_CHECK( fc::exists( data_dir.path() / "frames-0000000000" ) );
+      BOOST_CHECK( fc::exists( data_dir.path() / "frames-0000000016" ) );
+      BOOST_CHECK( !fc::exists( data_dir.path() / "frames-0000000032" ) );
+
+      block_database bdb;
+      bdb.set_cache_size( 0 );
+      bdb.open( data_dir.path() );
+      for( uint32_t i = 1; i < 60; ++i )
+      {
+         BOOST_CHECK( bdb.fetch_by_number( i )->id() == blocks[i].id() );
+         BOOST_CHECK( *bdb.fetch_packed( blocks[i].id() ) == fc::raw::pack( blocks[i] ) );
+      }
+
+      // a block stored into a compressed segment is appended next to the frames
+      signed_block replacement = blocks[5];
+      replacement.witness = witness_id_type( 5 );
+      bdb.remove( blocks[5].id() );
+      bdb.store( replacement.id(), replacement );
+      BOOST_CHECK( bdb.fetch_by_number( 5 )->id() == replacement.id() );
+      BOOST_CHECK( bdb.fetch_by_number( 6 )->id() == blocks[6].id() );
+      bdb.close();
+      bdb.open( data_dir.path() );
+      BOOST_CHECK( bdb.fetch_by_number( 5 )->id() == replacement.id() );
+      BOOST_CHECK( bdb.fetch_by_number( 4 )->id() == blocks[4].id() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_prefetcher_order )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      std::vector<block_id_type> ids( 1 );
+      signed_block b;
+      for( uint32_t i = 1; i <= 500; ++i )
+      {
+         if( i > 1 ) b.previous = b.id();
+         bdb.store( b.id(), b );
+         ids.push_back( b.id() );
+      }
+
+      {
+         block_prefetcher blocks( bdb, 1, 500, 3, 8 );
+         for( uint32_t i = 1; i <= 500; ++i )
+         {
+            auto next = blocks.next();
+            BOOST_REQUIRE( next.valid() );
+            BOOST_CHECK( next->id() == ids[i] );
+         }
+         BOOST_CHECK( !blocks.next().valid() );
+      }
+
+      // a missing block ends the sequence, workers which are still busy are stopped on destruction
+      bdb.remove( ids[300] );
+      block_prefetcher blocks( bdb, 250, 500, 4, 16 );
+      for( uint32_t i = 250; i < 300; ++i )
+         BOOST_CHECK( blocks.next()->id() == ids[i] );
+      BOOST_CHECK( !blocks.next().valid() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( generate_empty_blocks )
 {
    try {
@@ -177,6 +599,200 @@ BOOST_AUTO_TEST_CASE( generate_empty_blocks )
    }
 }
 
+BOOST_AUTO_TEST_CASE( journal_recovery )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type head_id;
+      {
+         database db;
+         db.enable_journal();
+         db.set_checkpoint_interval( 20 );
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 50; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         head_id = db.head_block_id();
+         // leave without close() to simulate a crash
+      }
+      {
+         database db;
+         db.enable_journal();
+         db.open(data_dir.path(), make_genesis );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 50 );
+         BOOST_CHECK( db.head_block_id() == head_id );
+         db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         BOOST_CHECK_EQUAL( db.head_block_num(), 51 );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( journal_garbage_tail )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type head_id;
+      {
+         database db;
+         db.enable_journal();
+         db.set_checkpoint_interval( 20 );
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 40; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+      }
+      {
+         // the journal grew before a crash but its contents never reached the disk
+         std::ofstream out( ( data_dir.path() / "object_database" / "journal" ).generic_string(),
+                            std::ofstream::binary | std::ofstream::app );
+         const std::vector<char> zeros( 256 );
+         out.write( zeros.data(), zeros.size() );
+      }
+      {
+         database db;
+         db.enable_journal();
+         db.set_checkpoint_interval( 20 );
+         db.open(data_dir.path(), make_genesis );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 40 );
+         for( uint32_t i = 0; i < 5; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         head_id = db.head_block_id();
+      }
+      {
+         database db;
+         db.enable_journal();
+         db.open(data_dir.path(), make_genesis );
+         BOOST_CHECK_EQUAL( db.head_block_num(), 45 );
+         BOOST_CHECK( db.head_block_id() == head_id );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( reindex_blocks )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type last_id;
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 100; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         // close() pops the blocks above the last irreversible one
+         last_id = db.get_block_id_for_num( db.get_dynamic_global_properties().last_irreversible_block_num );
+         db.close();
+      }
+      {
+         // a replay which fails after its checkpoint at block 60
+         database db;
+         db.set_replay_checkpoint_interval( 30 );
+         db.applied_block.connect( []( const signed_block& b ) {
+            if( b.block_num() == 70 )
+               FC_THROW( "interrupted" );
+         });
+         GRAPHENE_CHECK_THROW( db.reindex( data_dir.path(), make_genesis() ), fc::exception );
+      }
+      BOOST_REQUIRE( database::has_replay_checkpoint( data_dir.path() ) );
+
+      database db;
+      db.set_replay_threads( 3 );
+      uint32_t applied = 0;
+      db.applied_block.connect( [&]( const signed_block& ) { ++applied; } );
+      db.reindex( data_dir.path(), make_genesis(), true );
+      BOOST_CHECK( db.head_block_id() == last_id );
+      BOOST_CHECK_EQUAL( applied, block_header::num_from_id( last_id ) - 60 );
+      BOOST_CHECK( !database::has_replay_checkpoint( data_dir.path() ) );
+      db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+      BOOST_CHECK_EQUAL( db.head_block_num(), block_header::num_from_id( last_id ) + 1 );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( reindex_close_after_failure )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      block_id_type last_id;
+      {
+         database db;
+         db.open(data_dir.path(), make_genesis );
+         for( uint32_t i = 0; i < 100; ++i )
+            db.generate_block(db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         last_id = db.get_block_id_for_num( db.get_dynamic_global_properties().last_irreversible_block_num );
+         db.close();
+      }
+      {
+         // the application closes the database after the replay failed, which must keep the checkpoint at block 60
+         database db;
+         db.set_replay_checkpoint_interval( 30 );
+         db.applied_block.connect( []( const signed_block& b ) {
+            if( b.block_num() == 70 )
+               FC_THROW( "interrupted" );
+         });
+         GRAPHENE_CHECK_THROW( db.reindex( data_dir.path(), make_genesis() ), fc::exception );
+         db.close();
+      }
+      BOOST_REQUIRE( database::has_replay_checkpoint( data_dir.path() ) );
+
+      database db;
+      uint32_t applied = 0;
+      db.applied_block.connect( [&]( const signed_block& ) { ++applied; } );
+      db.reindex( data_dir.path(), make_genesis(), true );
+      BOOST_CHECK( db.head_block_id() == last_id );
+      BOOST_CHECK_EQUAL( applied, block_header::num_from_id( last_id ) - 60 );
+      BOOST_CHECK( !database::has_replay_checkpoint( data_dir.path() ) );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( state_digest )
+{
+   try {
+      fc::temp_directory data_dir1( graphene::utilities::temp_directory_path() );
+      fc::temp_directory data_dir2( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+
+      database db1, db2;
+      db1.enable_state_digest();
+      db2.enable_state_digest();
+      db1.open(data_dir1.path(), make_genesis );
+      db2.open(data_dir2.path(), make_genesis );
+      BOOST_CHECK( db1.state_digest() != fc::uint128() );
+      BOOST_CHECK( db1.state_digest() == db2.state_digest() );
+
+      for( uint32_t i = 0; i < 30; ++i )
+      {
+         auto b = db1.generate_block(db1.get_slot_time(1), db1.get_scheduled_witness(1), init_account_priv_key, database::skip_nothing);
+         db2.push_block( b, database::skip_nothing );
+         BOOST_CHECK_EQUAL( db1.get_state_digest().block_num, b.block_num() );
+         BOOST_CHECK( db1.get_state_digest().digest == db2.get_state_digest().digest );
+      }
+
+      // the incrementally maintained digest matches one computed from scratch, also after undoing blocks
+      const auto before_pop = db1.state_digest();
+      db1.pop_block();
+      auto incremental = db1.state_digest();
+      BOOST_CHECK( incremental != before_pop );
+      db1.reset_state_digest();
+      BOOST_CHECK( incremental == db1.state_digest() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( undo_block )
 {
    try {
@@ -546,6 +1162,281 @@ BOOST_AUTO_TEST_CASE( duplicate_transactions )
    }
 }
 
+BOOST_AUTO_TEST_CASE( block_signatures )
+{
+   try {
+      fc::temp_directory dir1( graphene::utilities::temp_directory_path() ),
+                         dir2( graphene::utilities::temp_directory_path() );
+      database db1,
+               db2;
+      db2.set_worker_threads( 3 );
+      db1.open(dir1.path(), make_genesis);
+      db2.open(dir2.path(), make_genesis);
+
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      public_key_type init_account_pub_key  = init_account_priv_key.get_public_key();
+      auto other_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("other_key")) );
+      const graphene::db::index& account_idx = db1.get_index(protocol_ids, account_object_type);
+
+      signed_transaction trx;
+      set_expiration( db1, trx );
+      account_id_type nathan_id = account_idx.get_next_id();
+      account_create_operation cop;
+      cop.name = "nathan";
+      cop.owner = authority(1, init_account_pub_key, 1);
+      cop.active = cop.owner;
+      trx.operations.push_back(cop);
+      transfer_operation t;
+      t.to = nathan_id;
+      t.amount = asset(500);
+      trx.operations.push_back(t);
+      PUSH_TX( db1, trx, skip_sigs );
+      auto b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      PUSH_BLOCK( db2, b, skip_sigs );
+
+      // several transactions signed by nathan, their keys are recovered once when they are pushed
+      for( int64_t amount = 1; amount <= 5; ++amount )
+      {
+         trx = decltype(trx)();
+         set_expiration( db1, trx );
+         t.from = nathan_id;
+         t.to = account_id_type();
+         t.amount = asset(amount);
+         trx.operations.push_back(t);
+         trx.sign( init_account_priv_key, db1.get_chain_id() );
+         PUSH_TX( db1, trx, database::skip_nothing );
+      }
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, database::skip_nothing );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 5 );
+      // the keys recovered when the transactions were pushed are reused to build the block
+      BOOST_CHECK_EQUAL( db1.get_signature_cache_stats().misses, 5 );
+      BOOST_CHECK_GE( db1.get_signature_cache_stats().hits, 5 );
+      // the merkle root in the signed header is checked against the digests computed before the block is applied
+      signed_block truncated = b;
+      truncated.transactions.pop_back();
+      GRAPHENE_CHECK_THROW( PUSH_BLOCK( db2, truncated, database::skip_nothing ), fc::exception );
+      // observers find the ids of the transactions hashed before the block was applied
+      uint32_t checked_ids = 0;
+      auto connection = db2.applied_block.connect( [&]( const signed_block& blk ) {
+         const auto& applied_trxs = db2.get_applied_transactions();
+         BOOST_REQUIRE_EQUAL( applied_trxs.size(), blk.transactions.size() );
+         for( uint32_t i = 0; i < applied_trxs.size(); ++i, ++checked_ids )
+            BOOST_CHECK( applied_trxs[i].id == blk.transactions[i].id() );
+      });
+      PUSH_BLOCK( db2, b, database::skip_nothing );
+      connection.disconnect();
+      BOOST_CHECK_EQUAL( checked_ids, 5 );
+      BOOST_CHECK_EQUAL(db2.get_balance(nathan_id, asset_id_type()).amount.value, 485);
+      // the signatures inside a block are covered by the signature of its witness and are not checked again
+      BOOST_CHECK_EQUAL( db2.get_signature_cache_stats().misses, 0 );
+
+      // so a block carrying a transaction with an unnecessary signature is accepted like on the rest of the network
+      for( int64_t amount = 6; amount <= 7; ++amount )
+      {
+         trx = decltype(trx)();
+         set_expiration( db1, trx );
+         t.amount = asset(amount);
+         trx.operations.push_back(t);
+         trx.sign( init_account_priv_key, db1.get_chain_id() );
+         if( amount == 7 )
+            trx.sign( other_priv_key, db1.get_chain_id() );
+         PUSH_TX( db1, trx, skip_sigs );
+      }
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip_sigs );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 2 );
+      PUSH_BLOCK( db2, b, database::skip_nothing );
+      BOOST_CHECK( db2.head_block_id() == b.id() );
+      BOOST_CHECK_EQUAL(db2.get_balance(nathan_id, asset_id_type()).amount.value, 485 - 6 - 7);
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( speculative_verification )
+{
+   try {
+      fc::temp_directory dir1( graphene::utilities::temp_directory_path() ),
+                         dir2( graphene::utilities::temp_directory_path() );
+      database db1,
+               db2;
+      db1.enable_state_digest();
+      db2.enable_speculative_verification();
+      db1.open(dir1.path(), make_genesis);
+      db2.open(dir2.path(), make_genesis);
+
+      // the transaction ids would otherwise serialize every block
+      auto skip = database::skip_transaction_signatures | database::skip_authority_check | database::skip_transaction_dupe_check;
+      auto init_account_priv_key  = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      public_key_type init_account_pub_key  = init_account_priv_key.get_public_key();
+      const graphene::db::index& account_idx = db1.get_index(protocol_ids, account_object_type);
+
+      vector<account_id_type> ids;
+      for( int i = 0; i < 6; ++i )
+      {
+         signed_transaction trx;
+         set_expiration( db1, trx );
+         ids.push_back( account_idx.get_next_id() );
+         account_create_operation cop;
+         cop.name = "spec" + fc::to_string( i );
+         cop.owner = authority(1, init_account_pub_key, 1);
+         cop.active = cop.owner;
+         trx.operations.push_back(cop);
+         transfer_operation t;
+         t.to = ids.back();
+         t.amount = asset(1000);
+         trx.operations.push_back(t);
+         PUSH_TX( db1, trx, skip );
+      }
+      auto b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip );
+      PUSH_BLOCK( db2, b, skip );
+
+      // three disjoint transfers and one which has to wait for the first
+      const std::vector< std::pair<int,int> > transfers = { {0,1}, {2,3}, {4,5}, {1,0} };
+      for( const auto& p : transfers )
+      {
+         signed_transaction trx;
+         set_expiration( db1, trx );
+         transfer_operation t;
+         t.from = ids[p.first];
+         t.to = ids[p.second];
+         t.amount = asset(100 + p.first);
+         trx.operations.push_back(t);
+         PUSH_TX( db1, trx, skip );
+      }
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip );
+      BOOST_CHECK_EQUAL( b.transactions.size(), 4 );
+      PUSH_BLOCK( db2, b, skip );
+
+      const auto& stats = db2.get_speculative_execution_stats();
+      BOOST_CHECK_EQUAL( stats.blocks, 2 );
+      BOOST_CHECK_EQUAL( stats.transactions, 10 );
+      BOOST_CHECK_EQUAL( stats.levels, 6 + 2 );
+      BOOST_CHECK_EQUAL( stats.mismatches, 0 );
+      BOOST_CHECK( db1.get_state_digest().digest == db2.get_state_digest().digest );
+      BOOST_CHECK_EQUAL( db2.get_balance( ids[0], asset_id_type() ).amount.value, 1000 - 100 + 101 );
+
+      // blocks applied with the dupe check, as live blocks are, are not verified
+      for( const auto& p : transfers )
+      {
+         signed_transaction trx;
+         set_expiration( db1, trx );
+         transfer_operation t;
+         t.from = ids[p.first];
+         t.to = ids[p.second];
+         t.amount = asset(10 + p.first);
+         trx.operations.push_back(t);
+         PUSH_TX( db1, trx, skip );
+      }
+      b = db1.generate_block( db1.get_slot_time(1), db1.get_scheduled_witness( 1 ), init_account_priv_key, skip );
+      PUSH_BLOCK( db2, b, skip & ~database::skip_transaction_dupe_check );
+      BOOST_CHECK_EQUAL( stats.blocks, 2 );
+      BOOST_CHECK( db1.get_state_digest().digest == db2.get_state_digest().digest );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( worker_pool_for_each )
+{
+   try {
+      worker_pool pool( 3 );
+      std::vector<uint32_t> calls( 1000, 0 );
+      pool.for_each( calls.size(), [&]( size_t i ) { ++calls[i]; } );
+      BOOST_CHECK( std::all_of( calls.begin(), calls.end(), []( uint32_t c ) { return c == 1; } ) );
+
+      // the failure of the lowest index is reported, no matter which thread hit it first
+      try
+      {
+         pool.for_each( 100, []( size_t i ) { if( i % 10 == 7 ) FC_THROW( "failed ${i}", ("i",i) ); } );
+         BOOST_FAIL( "for_each did not throw" );
+      }
+      catch( const fc::exception& e )
+      {
+         BOOST_CHECK( e.to_string().find( "failed 7" ) != std::string::npos );
+      }
+
+      worker_pool none( 0 );
+      size_t sum = 0;
+      none.for_each( 10, [&]( size_t i ) { sum += i; } );
+      BOOST_CHECK_EQUAL( sum, 45 );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( transaction_history )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      auto init_account_priv_key = fc::ecc::private_key::regenerate(fc::sha256::hash(string("null_key")) );
+      public_key_type init_account_pub_key = init_account_priv_key.get_public_key();
+      auto skip_sigs = database::skip_transaction_signatures | database::skip_authority_check;
+      std::vector<transaction_id_type> ids;
+      uint32_t trx_block = 0;
+      {
+         database db;
+         db.set_transaction_history( true );
+         db.open(data_dir.path(), make_genesis );
+         db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, skip_sigs );
+
+         account_id_type nathan_id = db.get_index(protocol_ids, account_object_type).get_next_id();
+         signed_transaction trx;
+         set_expiration( db, trx );
+         account_create_operation cop;
+         cop.name = "nathan";
+         cop.owner = authority(1, init_account_pub_key, 1);
+         cop.active = cop.owner;
+         trx.operations.push_back(cop);
+         PUSH_TX( db, trx, skip_sigs );
+         ids.push_back( trx.id() );
+
+         trx = signed_transaction();
+         set_expiration( db, trx );
+         transfer_operation t;
+         t.to = nathan_id;
+         t.amount = asset(500);
+         trx.operations.push_back(t);
+         PUSH_TX( db, trx, skip_sigs );
+         ids.push_back( trx.id() );
+
+         trx_block = db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, skip_sigs ).block_num();
+         for( uint32_t i = 0; i < 50; ++i )
+            db.generate_block( db.get_slot_time(1), db.get_scheduled_witness(1), init_account_priv_key, skip_sigs );
+         // expired transactions are no longer known to the object database
+         BOOST_CHECK( !db.is_known_transaction( ids[1] ) );
+         auto loc = db.get_transaction_location( ids[1] );
+         BOOST_REQUIRE( loc.valid() );
+         BOOST_CHECK_EQUAL( loc->block_num, trx_block );
+         BOOST_CHECK_EQUAL( loc->trx_in_block, 1u );
+         BOOST_CHECK( !db.get_transaction_location( transaction_id_type() ).valid() );
+         db.close();
+      }
+      {
+         // a history which was lost or never enabled is rebuilt from the stored blocks
+         fc::remove( data_dir.path() / "database" / "transaction_history" );
+         database db;
+         db.set_transaction_history( true );
+         db.open(data_dir.path(), make_genesis );
+         BOOST_REQUIRE_GE( db.head_block_num(), trx_block );
+         for( uint32_t i = 0; i < ids.size(); ++i )
+         {
+            auto loc = db.get_transaction_location( ids[i] );
+            BOOST_REQUIRE( loc.valid() );
+            BOOST_CHECK_EQUAL( loc->block_num, trx_block );
+            BOOST_CHECK_EQUAL( loc->trx_in_block, i );
+         }
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( tapos )
 {
    try {
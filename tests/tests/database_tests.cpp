@@ -24,6 +24,9 @@
 #include <graphene/chain/database.hpp>
 
 #include <graphene/chain/account_object.hpp>
+#include <graphene/chain/market_evaluator.hpp>
+
+#include <graphene/utilities/tempdir.hpp>
 
 #include <fc/crypto/digest.hpp>
 
@@ -56,3 +59,235 @@ BOOST_AUTO_TEST_CASE( undo_test )
       throw;
    }
 }
+
+BOOST_AUTO_TEST_CASE( checkpoint_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      account_balance_id_type kept, changed, removed, added;
+      {
+         database db;
+         db.object_database::open( data_dir.path() );
+         kept = db.create<account_balance_object>( [&]( account_balance_object& obj ){ obj.owner = account_id_type(1); obj.balance = 1; } ).id;
+         changed = db.create<account_balance_object>( [&]( account_balance_object& obj ){ obj.owner = account_id_type(2); obj.balance = 2; } ).id;
+         removed = db.create<account_balance_object>( [&]( account_balance_object& obj ){ obj.owner = account_id_type(3); obj.balance = 3; } ).id;
+         db.object_database::flush();
+
+         db.modify( changed(db), [&]( account_balance_object& obj ){ obj.balance = 20; } );
+         db.remove( removed(db) );
+         added = db.create<account_balance_object>( [&]( account_balance_object& obj ){ obj.owner = account_id_type(4); obj.balance = 4; } ).id;
+         db.object_database::checkpoint();
+         BOOST_CHECK( fc::exists( data_dir.path() / "object_database" / fc::to_string( account_balance_object::space_id )
+                                  / ( fc::to_string( account_balance_object::type_id ) + ".delta" ) ) );
+      }
+      {
+         database db;
+         db.object_database::open( data_dir.path() );
+         BOOST_CHECK( kept(db).balance == 1 );
+         BOOST_CHECK( changed(db).balance == 20 );
+         BOOST_CHECK( db.find( removed ) == nullptr );
+         BOOST_CHECK( added(db).balance == 4 );
+         BOOST_CHECK( db.get_index<account_balance_object>().get_next_id() == object_id_type( added ) + 1 );
+      }
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( checkpoint_garbage_tail_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      const fc::path delta_file = data_dir.path() / "object_database" / fc::to_string( account_balance_object::space_id )
+                                  / ( fc::to_string( account_balance_object::type_id ) + ".delta" );
+      account_balance_id_type first, second;
+      {
+         database db;
+         db.object_database::open( data_dir.path() );
+         db.create<account_balance_object>( [&]( account_balance_object& obj ){ obj.owner = account_id_type(1); } );
+         db.object_database::flush();
+         first = db.create<account_balance_object>( [&]( account_balance_object& obj ){ obj.owner = account_id_type(2); obj.balance = 2; } ).id;
+         db.object_database::checkpoint();
+      }
+      const auto good_size = fc::file_size( delta_file );
+      {
+         // a crash after the file grew but before its contents reached the disk leaves zeros behind
+         std::ofstream out( delta_file.generic_string(), std::ofstream::binary | std::ofstream::app );
+         const std::vector<char> zeros( 64 );
+         out.write( zeros.data(), zeros.size() );
+      }
+      {
+         database db;
+         db.object_database::open( data_dir.path() );
+         BOOST_CHECK_EQUAL( fc::file_size( delta_file ), good_size );
+         BOOST_CHECK( first(db).balance == 2 );
+         second = db.create<account_balance_object>( [&]( account_balance_object& obj ){ obj.owner = account_id_type(3); obj.balance = 3; } ).id;
+         db.object_database::checkpoint();
+      }
+      {
+         database db;
+         db.object_database::open( data_dir.path() );
+         BOOST_CHECK( first(db).balance == 2 );
+         BOOST_CHECK( second(db).balance == 3 );
+         BOOST_CHECK( db.get_index<account_balance_object>().get_next_id() == object_id_type( second ) + 1 );
+      }
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( flat_id_map_test )
+{
+   try {
+      graphene::db::flat_id_map<uint64_t> m;
+      std::map<object_id_type, uint64_t> expected;
+      for( uint64_t i = 0; i < 1000; ++i )
+      {
+         object_id_type id( 1, uint8_t(i % 7), i * 13 );
+         BOOST_CHECK( m.emplace( id, i ).second );
+         BOOST_CHECK( !m.emplace( id, i + 1 ).second );
+         expected[id] = i;
+      }
+      for( uint64_t i = 0; i < 1000; i += 3 )
+      {
+         object_id_type id( 1, uint8_t(i % 7), i * 13 );
+         m.erase( id );
+         expected.erase( id );
+      }
+      BOOST_CHECK_EQUAL( m.size(), expected.size() );
+      for( const auto& item : expected )
+      {
+         auto itr = m.find( item.first );
+         BOOST_REQUIRE( itr != m.end() );
+         BOOST_CHECK_EQUAL( itr->second, item.second );
+      }
+      BOOST_CHECK( m.find( object_id_type( 1, 0, 0 ) ) == m.end() );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( delta_undo_test )
+{
+   try {
+      database db;
+      db._undo_db.set_delta_encoding( true );
+      const auto& bal = db.create<account_balance_object>( [&]( account_balance_object& obj ){
+         obj.owner = account_id_type(1);
+         obj.balance = 1;
+      });
+
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.modify( bal, [&]( account_balance_object& obj ){ obj.balance = 2; } );
+         ses.commit();
+      }
+      {
+         auto ses = db._undo_db.start_undo_session();
+         db.modify( bal, [&]( account_balance_object& obj ){ obj.balance = 3; } );
+         auto nested = db._undo_db.start_undo_session();
+         db.modify( bal, [&]( account_balance_object& obj ){ obj.balance = 4; } );
+         nested.merge();
+         BOOST_CHECK( bal.balance == 4 );
+         ses.undo();
+      }
+      BOOST_CHECK( bal.balance == 2 );
+
+      db._undo_db.pop_commit();
+      BOOST_CHECK( bal.balance == 1 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( node_pool_test )
+{
+   try {
+      database db;
+      const auto& idx = db.get_index_type<limit_order_index>();
+      BOOST_REQUIRE( idx.pool_stats().valid() );
+      // the pool is shared by every limit_order_index in the process, only look at differences
+      const auto before = *idx.pool_stats();
+
+      vector<const limit_order_object*> orders;
+      for( uint32_t i = 0; i < 100; ++i )
+         orders.push_back( &db.create<limit_order_object>( [&]( limit_order_object& o ){
+            o.seller = account_id_type(i);
+         }));
+      auto stats = *idx.pool_stats();
+      BOOST_CHECK_EQUAL( stats.in_use, before.in_use + 100 );
+      BOOST_CHECK_EQUAL( stats.allocations, before.allocations + 100 );
+      BOOST_CHECK( stats.capacity >= stats.in_use );
+
+      for( const auto* o : orders )
+         db.remove( *o );
+      const auto capacity = idx.pool_stats()->capacity;
+      BOOST_CHECK_EQUAL( idx.pool_stats()->in_use, before.in_use );
+
+      // freed nodes are reused rather than growing the pool
+      for( uint32_t i = 0; i < 100; ++i )
+         db.create<limit_order_object>( [&]( limit_order_object& o ){ o.seller = account_id_type(i); } );
+      BOOST_CHECK_EQUAL( idx.pool_stats()->capacity, capacity );
+      BOOST_CHECK_EQUAL( idx.pool_stats()->fallbacks, before.fallbacks );
+
+      BOOST_CHECK( !db.get_index_type<account_balance_index>().pool_stats().valid() );
+
+      const auto pools = db.get_index_pool_stats();
+      auto itr = std::find_if( pools.begin(), pools.end(), []( const graphene::db::index_pool_stats& s ) {
+         return s.space_id == limit_order_object::space_id && s.type_id == limit_order_object::type_id;
+      });
+      BOOST_REQUIRE( itr != pools.end() );
+      BOOST_CHECK_EQUAL( itr->pool.in_use, idx.pool_stats()->in_use );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( slab_vector_test )
+{
+   try {
+      graphene::db::slab_vector<uint64_t, 2> slab;
+      uint64_t& first = slab.emplace( 0, 100 );
+      for( uint64_t i = 1; i < 20; ++i )
+         slab.emplace( i, i + 100 );
+      // growing must not move existing elements
+      BOOST_CHECK_EQUAL( &first, slab.find(0) );
+      BOOST_CHECK_EQUAL( slab.size(), 20 );
+
+      for( uint64_t i = 4; i < 8; ++i )
+         slab.erase( i );
+      slab.erase( 11 );
+      BOOST_CHECK( slab.find(5) == nullptr );
+      BOOST_CHECK( slab.find(11) == nullptr );
+      BOOST_CHECK_EQUAL( *slab.find(12), 112 );
+
+      vector<uint64_t> seen;
+      for( auto v : slab ) seen.push_back( v );
+      BOOST_CHECK_EQUAL( seen.size(), 15 );
+      BOOST_CHECK_EQUAL( seen[4], 108 );
+
+      for( uint64_t i = 12; i < 20; ++i )
+         slab.erase( i );
+      BOOST_CHECK_EQUAL( slab.size(), 11 );
+      slab.erase( 10 );
+      slab.erase( 9 );
+      slab.erase( 8 );
+      // the emptied chunk before the last live element is skipped when shrinking
+      BOOST_CHECK_EQUAL( slab.size(), 4 );
+      BOOST_CHECK( slab.begin() != slab.end() );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}